@@ -0,0 +1,110 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <fcntl.h>
+#include "common.h"
+#include "bufwriter.h"
+
+// Writing formatted records to a file:
+//   write       sprintf into a stack buffer + one write per record (io.c)
+//   FILE*       fprintf through stdio's default buffer
+//   bw 64K/1M   bw_printf with 4 x 64 KB or 4 x 1 MB buffers
+//   bw direct   bw_printf with 4 x 1 MB buffers and O_DIRECT
+//   bw put      bw_puts/bw_putl/bw_putc with 4 x 1 MB buffers
+// for small records ("hello world <n>\n") and large ones (LARGE bytes of
+// payload). We report records/sec, MB/s and system calls per record, and
+// check the file size.
+//
+// usage: bufwriter-bench [file] [small_mb] [large_mb]
+
+#define LARGE 8000
+
+char payload[LARGE + 1];
+
+// Returns bytes written; *calls gets the number of system calls.
+long run(const char *path, int mode, int large, long nrec, long *calls) {
+	long bytes = 0;
+	if(mode == 0) {
+		int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+		assert(fd >= 0);
+		char *buffer = malloc(LARGE + 64);
+		for(long i = 0; i < nrec; i++) {
+			if(large)
+				sprintf(buffer, "%ld %s\n", i, payload);
+			else
+				sprintf(buffer, "hello world %ld\n", i);
+			int len = strlen(buffer);
+			int rc = write(fd, buffer, len);
+			assert(rc == len);
+			bytes += len;
+		}
+		*calls = nrec;
+		free(buffer);
+		close(fd);
+	} else if(mode == 1) {
+		FILE *f = fopen(path, "w");
+		assert(f != NULL);
+		for(long i = 0; i < nrec; i++)
+			bytes += large ? fprintf(f, "%ld %s\n", i, payload) : fprintf(f, "hello world %ld\n", i);
+		fclose(f);
+		*calls = -1;
+	} else {
+		bw_t b;
+		int rc = bw_open(&b, path, mode == 2 ? 64 << 10 : 1 << 20, mode == 4 ? BW_DIRECT : 0);
+		assert(rc == 0);
+		for(long i = 0; i < nrec && mode != 5; i++)
+			bytes += large ? bw_printf(&b, "%ld %s\n", i, payload) : bw_printf(&b, "hello world %ld\n", i);
+		for(long i = 0; i < nrec && mode == 5; i++) {
+			if(!large)
+				bw_puts(&b, "hello world ");
+			bw_putl(&b, i);
+			if(large) {
+				bw_putc(&b, ' ');
+				bw_write(&b, payload, LARGE);
+			}
+			bw_putc(&b, '\n');
+		}
+		if(mode == 5)
+			bytes = bw_tell(&b);
+		bw_close(&b);
+		*calls = b.syscalls;
+	}
+	return bytes;
+}
+
+int main(int argc, char *argv[]) {
+	char *path = argc > 1 ? argv[1] : "/tmp/bwtest";
+	long small_mb = argc > 2 ? atol(argv[2]) : 32;
+	long large_mb = argc > 3 ? atol(argv[3]) : 256;
+	const char *names[] = { "write", "FILE*", "bw 64K", "bw 1M", "bw direct", "bw put" };
+	memset(payload, 'x', LARGE);
+
+	printf("%-6s %-10s %12s %10s %10s\n", "record", "mode", "records/s", "MB/s", "calls/rec");
+	for(int large = 0; large < 2; large++) {
+		long nrec = ((large ? large_mb : small_mb) << 20) / (large ? LARGE + 10 : 20);
+		for(int mode = 0; mode < 6; mode++) {
+			long calls;
+			double t = GetTime();
+			long bytes = run(path, mode, large, nrec, &calls);
+			t = GetTime() - t;
+			struct stat st;
+			int rc = stat(path, &st);
+			assert(rc == 0);
+			if(st.st_size != bytes) {
+				printf("oops! %s wrote %ld bytes, file has %ld\n", names[mode], bytes, (long) st.st_size);
+				exit(-1);
+			}
+			char c[16] = "?";		// stdio's calls are not ours to count
+			if(calls >= 0)
+				sprintf(c, "%.4f", (double) calls / nrec);
+			printf("%-6s %-10s %12.0f %10.1f %10s\n", large ? "large" : "small", names[mode],
+					nrec / t, bytes / t / (1 << 20), c);
+			fflush(stdout);
+		}
+	}
+	unlink(path);
+	return 0;
+}
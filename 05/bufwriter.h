@@ -0,0 +1,245 @@
+#ifndef __bufwriter_h__
+#define __bufwriter_h__
+
+// Buffered file writer, a leaner stand-in for stdio's FILE* when writing.
+//
+// io.c does one write system call per record. Here records are collected in
+// BW_NBUF page-aligned buffers of bufsz bytes; once they are all full, they
+// go out together in one writev. A record bigger than a buffer is not copied
+// at all but goes into that same writev straight from the caller's memory.
+//
+// bw_printf formats straight into the buffer (no temporary string, no extra
+// copy); bw_puts/bw_putc/bw_putl do the same for strings and numbers without
+// the cost of parsing a format; and bw_reserve/bw_commit let a caller
+// serialize into the buffer directly.
+//
+// With BW_DIRECT the file is opened O_DIRECT, so data goes from our buffers
+// to the device without passing through (and filling up) the page cache.
+// That only works in whole, aligned blocks, so bw_flush then holds back a
+// partial last block, and bw_close writes it with O_DIRECT turned off.
+// O_DIRECT needs _GNU_SOURCE defined before the first #include.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+
+#define BW_DIRECT 1
+#define BW_NBUF 4
+#define BW_ALIGN 4096		// buffer alignment and O_DIRECT block size
+
+typedef struct _bw_t {
+	int fd;
+	int flags;
+	size_t bufsz;			// multiple of BW_ALIGN
+	char *buf[BW_NBUF];
+	size_t fill[BW_NBUF];		// bytes in each buffer before buf[cur]
+	int cur;			// buffer being filled
+	size_t used;			// bytes in buf[cur]
+	off_t written;			// bytes handed to the kernel
+	long syscalls;
+} bw_t;
+
+// Open (create, truncate) path for writing. Returns 0, or -1 with errno set.
+int bw_open(bw_t *b, const char *path, size_t bufsz, int flags) {
+	b->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | (flags & BW_DIRECT ? O_DIRECT : 0),
+			S_IRUSR | S_IWUSR);
+	if(b->fd < 0)
+		return -1;
+	b->flags = flags;
+	b->bufsz = (bufsz + BW_ALIGN - 1) & ~(size_t) (BW_ALIGN - 1);
+	for(int i = 0; i < BW_NBUF; i++) {
+		b->buf[i] = aligned_alloc(BW_ALIGN, b->bufsz);
+		assert(b->buf[i] != NULL);
+	}
+	b->cur = 0;
+	b->used = 0;
+	b->written = 0;
+	b->syscalls = 0;
+	return 0;
+}
+
+// Write iov[0..n-1] completely.
+void bw_writev(bw_t *b, struct iovec *iov, int n) {
+	while(n > 0) {
+		ssize_t rc = writev(b->fd, iov, n);
+		assert(rc >= 0);
+		b->syscalls++;
+		b->written += rc;
+		while(n > 0 && (size_t) rc >= iov->iov_len) {
+			rc -= iov->iov_len;
+			iov++;
+			n--;
+		}
+		if(n > 0) {
+			iov->iov_base = (char*) iov->iov_base + rc;
+			iov->iov_len -= rc;
+		}
+	}
+}
+
+// Write out the full buffers, the filled part of the current one and then
+// extra (the caller's record, if any), all in one writev. In direct mode a
+// partial last block stays behind in buf[0].
+void bw_flush_with(bw_t *b, const void *extra, size_t extra_len) {
+	struct iovec iov[BW_NBUF + 1];
+	int n = 0;
+	for(int i = 0; i < b->cur; i++) {
+		iov[n].iov_base = b->buf[i];
+		iov[n++].iov_len = b->fill[i];
+	}
+	size_t keep = 0, out = b->used;
+	if(b->flags & BW_DIRECT) {
+		assert(extra_len == 0);
+		keep = out & (BW_ALIGN - 1);
+		out -= keep;
+	}
+	if(out > 0) {
+		iov[n].iov_base = b->buf[b->cur];
+		iov[n++].iov_len = out;
+	}
+	if(extra_len > 0) {
+		iov[n].iov_base = (void*) extra;
+		iov[n++].iov_len = extra_len;
+	}
+	bw_writev(b, iov, n);
+	if(keep > 0)
+		memmove(b->buf[0], b->buf[b->cur] + out, keep);
+	b->cur = 0;
+	b->used = keep;
+}
+
+void bw_flush(bw_t *b) {
+	bw_flush_with(b, NULL, 0);
+}
+
+// Make room for n contiguous bytes in the current buffer. Moves on to the
+// next buffer, or flushes when all are in use. In direct mode every buffer
+// but the last must be full, so a partly filled one is flushed instead.
+void bw_room(bw_t *b, size_t n) {
+	if(b->bufsz - b->used >= n)
+		return;
+	if(b->cur + 1 < BW_NBUF && !(b->flags & BW_DIRECT && b->used < b->bufsz)) {
+		b->fill[b->cur++] = b->used;
+		b->used = 0;
+		return;
+	}
+	bw_flush(b);
+	assert(b->bufsz - b->used >= n);
+}
+
+// Append len bytes.
+void bw_write(bw_t *b, const void *src, size_t len) {
+	const char *p = src;
+	if(len >= b->bufsz && !(b->flags & BW_DIRECT)) {
+		bw_flush_with(b, p, len);	// zero copy
+		return;
+	}
+	while(len > 0) {
+		if(b->used == b->bufsz)
+			bw_room(b, 1);
+		size_t k = b->bufsz - b->used;
+		if(k > len)
+			k = len;
+		memcpy(b->buf[b->cur] + b->used, p, k);
+		b->used += k;
+		p += k;
+		len -= k;
+	}
+}
+
+// A pointer to n contiguous bytes to fill in and then pass to bw_commit,
+// with the number actually used. n is at most bufsz (bufsz - BW_ALIGN in
+// direct mode, where up to a block may be held back).
+char *bw_reserve(bw_t *b, size_t n) {
+	assert(n <= b->bufsz);
+	bw_room(b, n);
+	return b->buf[b->cur] + b->used;
+}
+
+void bw_commit(bw_t *b, size_t n) {
+	assert(b->used + n <= b->bufsz);
+	b->used += n;
+}
+
+// printf into the buffer. Returns the number of bytes appended.
+int bw_printf(bw_t *b, const char *fmt, ...) {
+	va_list ap;
+	size_t room = b->bufsz - b->used;
+	va_start(ap, fmt);
+	int n = vsnprintf(b->buf[b->cur] + b->used, room, fmt, ap);
+	va_end(ap);
+	assert(n >= 0);
+	if((size_t) n < room) {
+		b->used += n;
+		return n;
+	}
+	// Did not fit: format it again into fresh room (or, if it is bigger
+	// than a whole buffer, into a temporary).
+	va_start(ap, fmt);
+	if((size_t) n < b->bufsz - (b->flags & BW_DIRECT ? BW_ALIGN : 0)) {
+		char *p = bw_reserve(b, n + 1);
+		vsnprintf(p, n + 1, fmt, ap);
+		bw_commit(b, n);
+	} else {
+		char *tmp = malloc(n + 1);
+		assert(tmp != NULL);
+		vsnprintf(tmp, n + 1, fmt, ap);
+		bw_write(b, tmp, n);
+		free(tmp);
+	}
+	va_end(ap);
+	return n;
+}
+
+// Bytes appended so far, flushed or not.
+off_t bw_tell(bw_t *b) {
+	off_t n = b->written + b->used;
+	for(int i = 0; i < b->cur; i++)
+		n += b->fill[i];
+	return n;
+}
+
+// Cheaper than bw_printf for the common pieces of a record: no format
+// string to parse, and the digits go straight into the buffer.
+void bw_puts(bw_t *b, const char *str) {
+	bw_write(b, str, strlen(str));
+}
+
+void bw_putc(bw_t *b, char c) {
+	if(b->used == b->bufsz)
+		bw_room(b, 1);
+	b->buf[b->cur][b->used++] = c;
+}
+
+void bw_putl(bw_t *b, long v) {
+	char tmp[24], *p = tmp + sizeof(tmp);
+	unsigned long u = v < 0 ? -(unsigned long) v : v;
+	do {
+		*--p = '0' + u % 10;
+		u /= 10;
+	} while(u > 0);
+	if(v < 0)
+		*--p = '-';
+	bw_write(b, p, tmp + sizeof(tmp) - p);
+}
+
+int bw_close(bw_t *b) {
+	bw_flush(b);
+	if(b->used > 0) {
+		// The unaligned tail of an O_DIRECT file.
+		fcntl(b->fd, F_SETFL, fcntl(b->fd, F_GETFL) & ~O_DIRECT);
+		struct iovec iov = { b->buf[0], b->used };
+		bw_writev(b, &iov, 1);
+	}
+	for(int i = 0; i < BW_NBUF; i++)
+		free(b->buf[i]);
+	return close(b->fd);
+}
+
+#endif // __bufwriter_h__
@@ -4,6 +4,7 @@
 #include <sys/time.h>
 #include <sys/stat.h>
 #include <assert.h>
+#include <stdlib.h>
 
 double GetTime() {
     struct timeval t;
@@ -18,4 +19,17 @@ void Spin(int howlong) {
 	; // do nothing in loop
 }
 
+int CmpDouble(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// p-th percentile (0..100) of v[0..n-1]; sorts v in place.
+double Percentile(double *v, int n, double p) {
+    assert(n > 0);
+    qsort(v, n, sizeof(double), CmpDouble);
+    int i = (int) (p / 100 * (n - 1) + 0.5);
+    return v[i];
+}
+
 #endif // __common_h__
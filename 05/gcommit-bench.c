@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include "common.h"
+#include "gcommit.h"
+
+// fsync.c's 12-byte "hello world\n" records, appended durably by 1..64
+// threads for <secs> seconds each:
+//   fsync    every thread does write + fsync per record, as in fsync.c
+//   gcommit  every thread does gc_append (group commit)
+// We report durable records/sec, commit latency p50/p99 and, for gcommit,
+// the average number of records per flush. First, one thread submits more
+// records than fit in a batch before it waits, which must not block.
+//
+// usage: gcommit-bench [file] [secs]
+
+#define MAX_LAT 1000000
+
+typedef struct _arg_t {
+	int mode;
+	double *lat;
+	int n;
+} arg_t;
+
+int fd;
+gc_t g;
+double secs, deadline;
+
+void *appender(void *p) {
+	arg_t *a = (arg_t*) p;
+	char buffer[20];
+	sprintf(buffer, "hello world\n");
+	int len = strlen(buffer);
+	while(a->n < MAX_LAT) {
+		double t = GetTime();
+		if(t >= deadline)
+			break;
+		if(a->mode == 0) {
+			int rc = write(fd, buffer, len);
+			assert(rc == len);
+			fsync(fd);
+		} else {
+			gc_append(&g, buffer, len);
+		}
+		a->lat[a->n++] = GetTime() - t;
+	}
+	return NULL;
+}
+
+// gc_submit on a full queue with no leader has to lead itself.
+void check_overlap(char *path) {
+	static char rec[] = "hello world\n";
+	long n = 3 * GC_BATCH + 1, seq = 0;
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, S_IRUSR | S_IWUSR);
+	assert(fd >= 0);
+	gc_init(&g, fd);
+	for(long i = 0; i < n; i++)
+		seq = gc_submit(&g, rec, 12);
+	gc_wait(&g, seq);
+	struct stat st;
+	fstat(fd, &st);
+	if(st.st_size != n * 12) {
+		printf("oops! submit-then-wait wrote %ld bytes, expected %ld\n", (long) st.st_size, n * 12);
+		exit(-1);
+	}
+	gc_destroy(&g);
+	close(fd);
+}
+
+int main(int argc, char *argv[]) {
+	char *path = argc > 1 ? argv[1] : "/tmp/gctest";
+	secs = argc > 2 ? atof(argv[2]) : 1;
+	check_overlap(path);
+	const char *names[] = { "fsync", "gcommit" };
+	printf("%-8s %7s %12s %10s %10s %8s\n", "mode", "threads", "records/s",
+			"p50 us", "p99 us", "batch");
+	for(int mode = 0; mode < 2; mode++) {
+		for(int nt = 1; nt <= 64; nt *= 2) {
+			fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, S_IRUSR | S_IWUSR);
+			assert(fd >= 0);
+			gc_init(&g, fd);
+			pthread_t th[64];
+			arg_t a[64];
+			double start = GetTime();
+			deadline = start + secs;
+			for(int i = 0; i < nt; i++) {
+				a[i].mode = mode;
+				a[i].lat = malloc(MAX_LAT * sizeof(double));
+				a[i].n = 0;
+				assert(a[i].lat != NULL);
+				int rc = pthread_create(&th[i], NULL, appender, &a[i]);
+				assert(rc == 0);
+			}
+			for(int i = 0; i < nt; i++)
+				pthread_join(th[i], NULL);
+			double elapsed = GetTime() - start;
+
+			int total = 0;
+			for(int i = 0; i < nt; i++)
+				total += a[i].n;
+			double *all = malloc(total * sizeof(double));
+			assert(all != NULL);
+			for(int i = 0, k = 0; i < nt; i++) {
+				memcpy(all + k, a[i].lat, a[i].n * sizeof(double));
+				k += a[i].n;
+				free(a[i].lat);
+			}
+			struct stat st;
+			fstat(fd, &st);
+			if(st.st_size != (off_t) total * 12) {
+				printf("oops! file has %ld bytes, expected %ld\n", (long) st.st_size, (long) total * 12);
+				exit(-1);
+			}
+			double batch = mode == 1 && g.batches > 0 ? (double) g.flushed / g.batches : 1;
+			printf("%-8s %7d %12.0f %10.1f %10.1f %8.1f\n", names[mode], nt, total / elapsed,
+					Percentile(all, total, 50) * 1e6, Percentile(all, total, 99) * 1e6, batch);
+			fflush(stdout);
+			free(all);
+			gc_destroy(&g);
+			close(fd);
+		}
+	}
+	unlink(path);
+	return 0;
+}
@@ -0,0 +1,140 @@
+#ifndef __gcommit_h__
+#define __gcommit_h__
+
+// Durable append log with group commit.
+//
+// fsync.c pays one device flush per 12-byte record. Here concurrent
+// appenders queue their records and one of them, the leader, writes the
+// whole queue with a single pwritev and makes it durable with a single
+// fdatasync. Records that arrive while the leader is flushing pile up in the
+// next batch, so the more appenders there are, the bigger the batches get
+// and the fewer flushes each record pays for.
+//
+// gc_append returns once the record is on disk. gc_submit only queues it
+// and returns a sequence number to pass to gc_wait later; the record's
+// buffer must stay untouched until then, since it is written from in place.
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#define GC_BATCH 1024		// records per pwritev, at most IOV_MAX
+
+typedef struct _gc_t {
+	int fd;
+	off_t off;			// where the next batch goes
+	pthread_mutex_t lock;
+	pthread_cond_t durable_cv;	// durable moved, or the leader left
+	pthread_cond_t room_cv;		// the queue has room again
+	struct iovec *q, *spare;	// queued records; spare is the leader's
+	int n;
+	long queued;			// seq of the last queued record
+	long durable;			// every record up to this seq is on disk
+	int leading;
+	long batches, flushed;		// stats
+} gc_t;
+
+// Appends go after whatever fd already holds.
+void gc_init(gc_t *g, int fd) {
+	g->fd = fd;
+	g->off = lseek(fd, 0, SEEK_END);
+	assert(g->off >= 0);
+	pthread_mutex_init(&g->lock, NULL);
+	pthread_cond_init(&g->durable_cv, NULL);
+	pthread_cond_init(&g->room_cv, NULL);
+	g->q = malloc(GC_BATCH * sizeof(struct iovec));
+	g->spare = malloc(GC_BATCH * sizeof(struct iovec));
+	assert(g->q != NULL && g->spare != NULL);
+	g->n = 0;
+	g->queued = g->durable = 0;
+	g->leading = 0;
+	g->batches = g->flushed = 0;
+}
+
+void gc_destroy(gc_t *g) {
+	free(g->q);
+	free(g->spare);
+}
+
+// Write out and sync the queue. Called with the lock held, as the leader.
+void gc_lead(gc_t *g) {
+	struct iovec *b = g->q;
+	int n = g->n;
+	long last = g->queued;
+	off_t off = g->off;
+	size_t len = 0;
+	for(int i = 0; i < n; i++)
+		len += b[i].iov_len;
+	g->q = g->spare;
+	g->n = 0;
+	g->off += len;
+	pthread_cond_broadcast(&g->room_cv);
+	pthread_mutex_unlock(&g->lock);
+
+	// Nobody else touches b until we hand it back as the spare.
+	for(int i = 0; len > 0; ) {
+		ssize_t rc = pwritev(g->fd, b + i, n - i, off);
+		assert(rc > 0);
+		off += rc;
+		len -= rc;
+		while(i < n && rc >= (ssize_t) b[i].iov_len)
+			rc -= b[i++].iov_len;
+		if(rc > 0) {
+			b[i].iov_base = (char*) b[i].iov_base + rc;
+			b[i].iov_len -= rc;
+		}
+	}
+	int rc = fdatasync(g->fd);
+	assert(rc == 0);
+
+	pthread_mutex_lock(&g->lock);
+	g->spare = b;
+	g->durable = last;
+	g->batches++;
+	g->flushed += n;
+	g->leading = 0;
+	pthread_cond_broadcast(&g->durable_cv);
+}
+
+// Queue a record and return its sequence number.
+long gc_submit(gc_t *g, const void *buf, size_t len) {
+	pthread_mutex_lock(&g->lock);
+	while(g->n == GC_BATCH) {
+		// Only a leader empties the queue. If there is none (say, one
+		// thread submitting ahead of its gc_wait), become it.
+		if(!g->leading) {
+			g->leading = 1;
+			gc_lead(g);
+		} else {
+			pthread_cond_wait(&g->room_cv, &g->lock);
+		}
+	}
+	g->q[g->n].iov_base = (void*) buf;
+	g->q[g->n].iov_len = len;
+	g->n++;
+	long seq = ++g->queued;
+	pthread_mutex_unlock(&g->lock);
+	return seq;
+}
+
+// Block until record seq is durable, leading a flush when nobody else is.
+void gc_wait(gc_t *g, long seq) {
+	pthread_mutex_lock(&g->lock);
+	while(g->durable < seq) {
+		if(!g->leading) {
+			g->leading = 1;
+			gc_lead(g);
+		} else {
+			pthread_cond_wait(&g->durable_cv, &g->lock);
+		}
+	}
+	pthread_mutex_unlock(&g->lock);
+}
+
+void gc_append(gc_t *g, const void *buf, size_t len) {
+	gc_wait(g, gc_submit(g, buf, len));
+}
+
+#endif // __gcommit_h__
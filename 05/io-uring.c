@@ -0,0 +1,47 @@
+#include <stdio.h>
+#include <unistd.h> 
+#include <assert.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <string.h>
+#include "uring.h"
+
+// io.c's write / overwrite / append / read-back sequence as one linked
+// io_uring chain: one system call submits all five operations, and each
+// only starts once the one before it has succeeded.
+
+#define BUF_LEN 20
+
+int main(int argc, char *argv[]) {
+	uio_t u;
+	uio_init(&u, 8, argc > 1 && strcmp(argv[1], "-sync") == 0);
+	int fd = open("/tmp/file", O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+	assert(fd >= 0);
+	int rc = uio_register_files(&u, &fd, 1);
+	assert(rc == 0);
+
+	char hello[BUF_LEN], col[BUF_LEN], buffer[BUF_LEN];
+	sprintf(hello, "hello world\n");
+	sprintf(col, "COL331");
+	memset(buffer, 0, BUF_LEN);
+	uio_write(&u, 0, hello, strlen(hello), 0, 1, UIO_FIXED_FILE | UIO_LINK);
+	uio_write(&u, 0, col, strlen(col), 6, 2, UIO_FIXED_FILE | UIO_LINK);
+	uio_write(&u, 0, "!\n", 2, strlen(hello), 3, UIO_FIXED_FILE | UIO_LINK);
+	uio_fsync(&u, 0, 4, UIO_FIXED_FILE | UIO_LINK);
+	uio_read(&u, 0, buffer, BUF_LEN, 0, 5, UIO_FIXED_FILE);
+	uio_submit(&u, 5);
+
+	for(int i = 0; i < 5; i++) {
+		uio_cqe_t c;
+		uio_wait(&u, &c);
+		assert(c.res >= 0);
+		if(c.ud == 5)
+			printf("%d: %s", c.res, buffer);
+	}
+	printf("%s, %ld system call(s) for 5 operations\n",
+			u.fallback ? "sync fallback" : "io_uring", u.enters);
+	close(fd);
+	uio_destroy(&u);
+	return 0;
+}
@@ -0,0 +1,153 @@
+#ifndef __mapfile_h__
+#define __mapfile_h__
+
+// Memory-mapped file access.
+//
+// io.c moves every byte through a user buffer with read/write, one system
+// call per chunk. Here the file is mapped once and read and written as
+// memory: mf_ptr hands out a pointer straight into the page cache, and
+// mf_read/mf_write are memcpy-based stand-ins for pread/pwrite.
+//
+// Open flags:
+//   MF_WRITE       map read-write (MAP_SHARED), so stores reach the file
+//   MF_CREATE      create the file if needed and make it `size` bytes
+//   MF_POPULATE    fault the whole file in up front (MAP_POPULATE), so
+//                  later accesses take no page faults
+//   MF_SEQUENTIAL  MADV_SEQUENTIAL: read ahead aggressively, drop behind
+//   MF_RANDOM      MADV_RANDOM: no read-ahead
+//   MF_WILLNEED    MADV_WILLNEED: start reading the file in now
+//
+// Stores are only durable after mf_sync (msync), just as writes are only
+// durable after fsync.
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MF_WRITE 1
+#define MF_CREATE 2
+#define MF_POPULATE 4
+#define MF_SEQUENTIAL 8
+#define MF_RANDOM 16
+#define MF_WILLNEED 32
+
+typedef struct _mf_t {
+	int fd;
+	char *base;
+	size_t size;
+	int flags;
+} mf_t;
+
+// Give up on an mf_open after its open: close the fd, keep errno.
+int mf_fail(mf_t *m) {
+	int err = errno;
+	close(m->fd);
+	errno = err;
+	return -1;
+}
+
+// size is only used with MF_CREATE; otherwise the file's own size is mapped.
+// Returns 0, or -1 with errno set.
+int mf_open(mf_t *m, const char *path, int flags, size_t size) {
+	int oflags = flags & MF_WRITE ? O_RDWR : O_RDONLY;
+	if(flags & MF_CREATE)
+		oflags |= O_CREAT;
+	m->fd = open(path, oflags, S_IRUSR | S_IWUSR);
+	if(m->fd < 0)
+		return -1;
+	if(flags & MF_CREATE) {
+		if(ftruncate(m->fd, size) != 0)
+			return mf_fail(m);
+	} else {
+		struct stat st;
+		if(fstat(m->fd, &st) != 0)
+			return mf_fail(m);
+		size = st.st_size;
+	}
+	m->size = size;
+	m->flags = flags;
+	m->base = NULL;
+	if(size == 0)
+		return 0;
+	m->base = mmap(NULL, size, PROT_READ | (flags & MF_WRITE ? PROT_WRITE : 0),
+			(flags & MF_WRITE ? MAP_SHARED : MAP_PRIVATE) | (flags & MF_POPULATE ? MAP_POPULATE : 0),
+			m->fd, 0);
+	if(m->base == MAP_FAILED)
+		return mf_fail(m);
+	if(flags & MF_SEQUENTIAL)
+		madvise(m->base, size, MADV_SEQUENTIAL);
+	if(flags & MF_RANDOM)
+		madvise(m->base, size, MADV_RANDOM);
+	if(flags & MF_WILLNEED)
+		madvise(m->base, size, MADV_WILLNEED);
+	return 0;
+}
+
+void mf_close(mf_t *m) {
+	if(m->base != NULL)
+		munmap(m->base, m->size);
+	close(m->fd);
+}
+
+// Direct pointer to byte off; valid until mf_close or mf_resize.
+char *mf_ptr(mf_t *m, size_t off) {
+	assert(off <= m->size);
+	return m->base + off;
+}
+
+// Hint how [off, off+len) is about to be used (an MADV_* value).
+int mf_advise(mf_t *m, size_t off, size_t len, int advice) {
+	size_t start = off & ~(size_t) (getpagesize() - 1);
+	return madvise(m->base + start, len + (off - start), advice);
+}
+
+// Like pread/pwrite: copies up to len bytes, returns how many (0 at EOF).
+// Writes do not grow the file; see mf_resize.
+size_t mf_read(mf_t *m, size_t off, void *buf, size_t len) {
+	if(off >= m->size)
+		return 0;
+	if(len > m->size - off)
+		len = m->size - off;
+	memcpy(buf, m->base + off, len);
+	return len;
+}
+
+size_t mf_write(mf_t *m, size_t off, const void *buf, size_t len) {
+	assert(m->flags & MF_WRITE);
+	if(off >= m->size)
+		return 0;
+	if(len > m->size - off)
+		len = m->size - off;
+	memcpy(m->base + off, buf, len);
+	return len;
+}
+
+// Grow or shrink the file and its mapping. Pointers from mf_ptr go stale.
+int mf_resize(mf_t *m, size_t size) {
+	assert(m->flags & MF_WRITE);
+	if(ftruncate(m->fd, size) != 0)
+		return -1;
+	char *p;
+	if(m->base == NULL)
+		p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, m->fd, 0);
+	else
+		p = mremap(m->base, m->size, size, MREMAP_MAYMOVE);
+	if(p == MAP_FAILED)
+		return -1;
+	m->base = p;
+	m->size = size;
+	return 0;
+}
+
+// Write dirty pages in [off, off+len) back to the file. With wait, returns
+// once they are on disk (MS_SYNC); otherwise just starts the writeback.
+int mf_sync(mf_t *m, size_t off, size_t len, int wait) {
+	size_t start = off & ~(size_t) (getpagesize() - 1);
+	return msync(m->base + start, len + (off - start), wait ? MS_SYNC : MS_ASYNC);
+}
+
+#endif // __mapfile_h__
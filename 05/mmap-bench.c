@@ -0,0 +1,179 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <assert.h>
+#include <fcntl.h>
+#include "common.h"
+#include "mapfile.h"
+
+// Sequential and random read throughput on files of 1 MB up to <max_mb>,
+// through read()/pread() into buffers of different sizes and through
+// mapfile.h with different hints. Every byte read is summed, so both sides
+// do the same work on the data. Random reads are RAND_OPS 4 KB blocks at
+// random offsets. Files are read once before timing, so this measures the
+// page-cache path; pass -cold to drop them from the cache before each run
+// instead.
+//
+// usage: mmap-bench [max_mb] [file] [-cold]
+
+#define BLK 4096
+#define RAND_OPS 100000
+
+int cold;
+
+uint64_t sum(const char *p, size_t n) {
+	const uint64_t *w = (const uint64_t*) p;
+	uint64_t s = 0;
+	for(size_t i = 0; i < n / 8; i++)
+		s += w[i];
+	for(size_t i = n & ~7UL; i < n; i++)
+		s += (unsigned char) p[i];
+	return s;
+}
+
+void prepare(const char *path, size_t size) {
+	int fd = open(path, O_RDONLY);
+	assert(fd >= 0);
+	if(cold) {
+		posix_fadvise(fd, 0, size, POSIX_FADV_DONTNEED);
+	} else {
+		char *buf = malloc(1 << 20);
+		while(read(fd, buf, 1 << 20) > 0)
+			;
+		free(buf);
+	}
+	close(fd);
+}
+
+// MB/s for a sequential pass with read(); *s gets the sum.
+double seq_read(const char *path, size_t size, size_t bufsz, uint64_t *s) {
+	prepare(path, size);
+	char *buf = aligned_alloc(BLK, bufsz);
+	assert(buf != NULL);
+	double t = GetTime();
+	int fd = open(path, O_RDONLY);
+	assert(fd >= 0);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	ssize_t n;
+	*s = 0;
+	while((n = read(fd, buf, bufsz)) > 0)
+		*s += sum(buf, n);
+	close(fd);
+	t = GetTime() - t;
+	free(buf);
+	return size / t / (1 << 20);
+}
+
+double seq_mmap(const char *path, size_t size, int flags, uint64_t *s) {
+	prepare(path, size);
+	double t = GetTime();
+	mf_t m;
+	int rc = mf_open(&m, path, flags, 0);
+	assert(rc == 0);
+	*s = sum(mf_ptr(&m, 0), m.size);
+	mf_close(&m);
+	t = GetTime() - t;
+	return size / t / (1 << 20);
+}
+
+// Random 4 KB reads per second.
+double rand_read(const char *path, size_t size, uint64_t *s) {
+	prepare(path, size);
+	char buf[BLK];
+	unsigned seed = 1;
+	double t = GetTime();
+	int fd = open(path, O_RDONLY);
+	assert(fd >= 0);
+	*s = 0;
+	for(int i = 0; i < RAND_OPS; i++) {
+		off_t off = (off_t) (rand_r(&seed) % (size / BLK)) * BLK;
+		ssize_t n = pread(fd, buf, BLK, off);
+		assert(n == BLK);
+		*s += sum(buf, BLK);
+	}
+	close(fd);
+	return RAND_OPS / (GetTime() - t);
+}
+
+double rand_mmap(const char *path, size_t size, int flags, uint64_t *s) {
+	prepare(path, size);
+	unsigned seed = 1;
+	double t = GetTime();
+	mf_t m;
+	int rc = mf_open(&m, path, flags, 0);
+	assert(rc == 0);
+	*s = 0;
+	for(int i = 0; i < RAND_OPS; i++) {
+		size_t off = (size_t) (rand_r(&seed) % (size / BLK)) * BLK;
+		*s += sum(mf_ptr(&m, off), BLK);
+	}
+	mf_close(&m);
+	return RAND_OPS / (GetTime() - t);
+}
+
+void check(uint64_t want, uint64_t got, const char *what) {
+	if(want != got) {
+		printf("oops! %s sum %lx, expected %lx\n", what, (unsigned long) got, (unsigned long) want);
+		exit(-1);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	long max_mb = argc > 1 ? atol(argv[1]) : 1024;
+	char *path = argc > 2 ? argv[2] : "/tmp/mmaptest";
+	cold = argc > 3 && strcmp(argv[3], "-cold") == 0;
+	size_t bufs[] = { 4096, 65536, 1 << 20 };
+	struct { const char *name; int flags; } maps[] = {
+		{ "mmap", 0 },
+		{ "mmap+seq", MF_SEQUENTIAL | MF_WILLNEED },
+		{ "mmap+random", MF_RANDOM },
+		{ "mmap+populate", MF_POPULATE },
+	};
+
+	printf("%8s %-16s %12s %12s\n", "size MB", "mode", "seq MB/s", "rand ops/s");
+	for(long mb = 1; ; mb *= 8) {
+		if(mb > max_mb)
+			mb = max_mb;
+		size_t size = (size_t) mb << 20;
+		// Write the file through the mapping, then make it durable.
+		mf_t m;
+		int rc = mf_open(&m, path, MF_WRITE | MF_CREATE, size);
+		assert(rc == 0);
+		for(size_t off = 0; off < size; off += 8)
+			*(uint64_t*) mf_ptr(&m, off) = off * 0x9e3779b97f4a7c15ULL;
+		rc = mf_sync(&m, 0, size, 1);
+		assert(rc == 0);
+		mf_close(&m);
+
+		uint64_t want, s, rwant, rs;
+		for(int i = 0; i < 3; i++) {
+			char name[32];
+			sprintf(name, "read %zuK", bufs[i] >> 10);
+			double seq = seq_read(path, size, bufs[i], &s);
+			if(i == 0)
+				want = s;
+			check(want, s, name);
+			if(i > 0) {
+				printf("%8ld %-16s %12.0f %12s\n", mb, name, seq, "-");
+				continue;
+			}
+			double rnd = rand_read(path, size, &rwant);	// pread, 4K at a time
+			printf("%8ld %-16s %12.0f %12.0f\n", mb, name, seq, rnd);
+		}
+		for(int i = 0; i < 4; i++) {
+			double seq = seq_mmap(path, size, maps[i].flags, &s);
+			check(want, s, maps[i].name);
+			double rnd = rand_mmap(path, size, maps[i].flags, &rs);
+			check(rwant, rs, maps[i].name);
+			printf("%8ld %-16s %12.0f %12.0f\n", mb, maps[i].name, seq, rnd);
+		}
+		fflush(stdout);
+		if(mb == max_mb)
+			break;
+	}
+	unlink(path);
+	return 0;
+}
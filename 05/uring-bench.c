@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <fcntl.h>
+#include "common.h"
+#include "uring.h"
+
+// Small random reads and writes on a FILE_MB file, and write->fdatasync
+// pairs, done with plain pread/pwrite/fdatasync ("sync") and through
+// uring.h at queue depths 1..64, with and without registered files and
+// buffers, and through uring.h's synchronous fallback. We report ops/sec
+// and system calls per op.
+//
+// usage: uring-bench [file]
+
+#define FILE_MB 64
+#define BLK 4096
+#define OPS 200000
+#define SYNCS 2000
+#define MAXQD 64
+
+enum { READ, WRITE, WSYNC };
+const char *kinds[] = { "read", "write", "write+sync" };
+
+char *bufs;		// MAXQD blocks, one per slot in flight
+int fd;
+
+off_t rand_off(unsigned *seed) {
+	return (off_t) (rand_r(seed) % (FILE_MB * (1 << 20) / BLK)) * BLK;
+}
+
+// Returns ops/sec; *calls gets system calls per op.
+double run_sync(int kind, int ops, double *calls) {
+	unsigned seed = 1;
+	double t = GetTime();
+	for(int i = 0; i < ops; i++) {
+		off_t off = rand_off(&seed);
+		int rc = kind == READ ? pread(fd, bufs, BLK, off) : pwrite(fd, bufs, BLK, off);
+		assert(rc == BLK);
+		if(kind == WSYNC)
+			fdatasync(fd);
+	}
+	*calls = kind == WSYNC ? 2 : 1;
+	return ops / (GetTime() - t);
+}
+
+void issue(uio_t *u, int kind, int slot, unsigned *seed, int fixed) {
+	char *b = bufs + slot * BLK;
+	int f = fixed ? 0 : fd;
+	int flags = fixed ? UIO_FIXED_FILE | UIO_FIXED_BUF : 0;
+	off_t off = rand_off(seed);
+	if(kind == READ) {
+		uio_read(u, f, b, BLK, off, slot, flags);
+	} else {
+		uio_write(u, f, b, BLK, off, kind == WSYNC ? -1 : slot, flags | (kind == WSYNC ? UIO_LINK : 0));
+		if(kind == WSYNC)
+			uio_fsync(u, f, slot, fixed ? UIO_FIXED_FILE : 0);
+	}
+}
+
+double run_uring(int kind, int ops, int qd, int fixed, int fallback, double *calls) {
+	uio_t u;
+	uio_init(&u, kind == WSYNC ? 2 * qd : qd, fallback);
+	if(fixed) {
+		struct iovec iov = { bufs, MAXQD * BLK };
+		int rc = uio_register_files(&u, &fd, 1);
+		assert(rc == 0);
+		rc = uio_register_buffers(&u, &iov, 1);
+		assert(rc == 0);
+	}
+	unsigned seed = 1;
+	int issued = 0, done = 0;
+	double t = GetTime();
+	for(; issued < qd && issued < ops; issued++)
+		issue(&u, kind, issued, &seed, fixed);
+	uio_submit(&u, 0);
+	while(done < ops) {
+		uio_cqe_t c;
+		if(!uio_peek(&u, &c)) {
+			// Wait for half the queue, so one call reaps many completions.
+			uio_submit(&u, (issued - done + 1) / 2);
+			continue;
+		}
+		if(c.ud < 0)		// the write half of a write+sync pair
+			continue;
+		if(c.res < 0 || (kind != WSYNC && c.res != BLK)) {
+			printf("oops! op %ld returned %d\n", c.ud, c.res);
+			exit(-1);
+		}
+		done++;
+		if(issued < ops) {
+			issue(&u, kind, c.ud, &seed, fixed);
+			issued++;
+		}
+	}
+	double rate = ops / (GetTime() - t);
+	*calls = (double) u.enters / ops;
+	uio_destroy(&u);
+	return rate;
+}
+
+int main(int argc, char *argv[]) {
+	char *path = argc > 1 ? argv[1] : "/tmp/uringtest";
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+	assert(fd >= 0);
+	bufs = aligned_alloc(BLK, MAXQD * BLK);
+	assert(bufs != NULL);
+	memset(bufs, 'x', MAXQD * BLK);
+	for(int i = 0; i < FILE_MB * (1 << 20) / BLK; i++) {
+		int rc = write(fd, bufs, BLK);
+		assert(rc == BLK);
+	}
+	fsync(fd);
+
+	uio_t probe;
+	uio_init(&probe, 1, 0);
+	if(probe.fallback)
+		printf("io_uring not available, uring rows use the fallback\n");
+	uio_destroy(&probe);
+
+	printf("%-10s %-16s %4s %12s %10s\n", "op", "mode", "qd", "ops/s", "calls/op");
+	for(int kind = READ; kind <= WSYNC; kind++) {
+		int ops = kind == WSYNC ? SYNCS : OPS;
+		double calls, r = run_sync(kind, ops, &calls);
+		printf("%-10s %-16s %4d %12.0f %10.3f\n", kinds[kind], "sync", 1, r, calls);
+		for(int qd = 1; qd <= MAXQD; qd *= 4) {
+			r = run_uring(kind, ops, qd, 0, 0, &calls);
+			printf("%-10s %-16s %4d %12.0f %10.3f\n", kinds[kind], "uring", qd, r, calls);
+			r = run_uring(kind, ops, qd, 1, 0, &calls);
+			printf("%-10s %-16s %4d %12.0f %10.3f\n", kinds[kind], "uring+fixed", qd, r, calls);
+		}
+		r = run_uring(kind, ops, 16, 0, 1, &calls);
+		printf("%-10s %-16s %4d %12.0f %10.3f\n", kinds[kind], "fallback", 16, r, calls);
+		fflush(stdout);
+	}
+	close(fd);
+	unlink(path);
+	return 0;
+}
@@ -0,0 +1,275 @@
+#ifndef __uring_h__
+#define __uring_h__
+
+// Asynchronous file I/O on io_uring, with a synchronous fallback.
+//
+// Operations are queued with uio_read/uio_write/uio_fsync, handed to the
+// kernel in one io_uring_enter by uio_submit, and their results come back
+// through uio_peek/uio_wait tagged with the caller's ud (user data). So a
+// batch of N small reads or writes costs one system call instead of N.
+//
+// Flags on an operation:
+//   UIO_LINK        the next operation only starts once this one succeeds
+//                   (a failed or short one cancels the rest of the chain
+//                   with -ECANCELED), e.g. write -> fsync
+//   UIO_FIXED_FILE  fd is an index into the table given to uio_register_files
+//   UIO_FIXED_BUF   buf lies in a buffer given to uio_register_buffers, so
+//                   the kernel does not have to pin and map it on every call
+//
+// Talks to the kernel with raw system calls, so liburing is not needed.
+// Where io_uring is missing or disabled, uio_init sets u->fallback and every
+// operation runs right away with pread/pwrite/fdatasync and posts its
+// completion to a software queue, so callers do not need to care.
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define UIO_LINK 1
+#define UIO_FIXED_FILE 2
+#define UIO_FIXED_BUF 4
+
+typedef struct _uio_cqe_t {
+	long ud;
+	int res;		// bytes transferred, or -errno
+} uio_cqe_t;
+
+typedef struct _uio_t {
+	int fallback;
+	int ring_fd;
+	unsigned entries;
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq_ring, *cq_ring;
+	size_t sq_ring_sz, cq_ring_sz;
+	unsigned sq_local;	// our tail, published by uio_submit
+	int *files;		// registered fds
+	int nfiles;
+	struct iovec *bufs;	// registered buffers
+	int nbufs;
+	uio_cqe_t *fq;		// fallback completions
+	unsigned fq_head, fq_tail;
+	int link_broken;	// fallback: cancel the rest of this chain
+	long enters;		// io_uring_enter calls (or syscalls, in fallback)
+} uio_t;
+
+int uio_setup(unsigned entries, struct io_uring_params *p) {
+	return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+int uio_enter(uio_t *u, unsigned submit, unsigned complete) {
+	u->enters++;
+	return (int) syscall(__NR_io_uring_enter, u->ring_fd, submit, complete,
+			complete > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+// Room for entries queued operations. With force_fallback, or when the
+// kernel says no, operations run synchronously.
+void uio_init(uio_t *u, unsigned entries, int force_fallback) {
+	memset(u, 0, sizeof(uio_t));
+	u->entries = entries;
+	u->fq = malloc(2 * entries * sizeof(uio_cqe_t));
+	assert(u->fq != NULL);
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	u->ring_fd = force_fallback ? -1 : uio_setup(entries, &p);
+	if(u->ring_fd < 0) {
+		u->fallback = 1;
+		return;
+	}
+	u->entries = p.sq_entries;
+	u->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	u->cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if(p.features & IORING_FEAT_SINGLE_MMAP) {
+		if(u->cq_ring_sz > u->sq_ring_sz)
+			u->sq_ring_sz = u->cq_ring_sz;
+		u->cq_ring_sz = u->sq_ring_sz;
+	}
+	u->sq_ring = mmap(NULL, u->sq_ring_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_SQ_RING);
+	assert(u->sq_ring != MAP_FAILED);
+	u->cq_ring = u->sq_ring;
+	if(!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+		u->cq_ring = mmap(NULL, u->cq_ring_sz, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_CQ_RING);
+		assert(u->cq_ring != MAP_FAILED);
+	}
+	u->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_SQES);
+	assert(u->sqes != MAP_FAILED);
+	char *sq = u->sq_ring, *cq = u->cq_ring;
+	u->sq_head = (unsigned*) (sq + p.sq_off.head);
+	u->sq_tail = (unsigned*) (sq + p.sq_off.tail);
+	u->sq_mask = (unsigned*) (sq + p.sq_off.ring_mask);
+	u->sq_array = (unsigned*) (sq + p.sq_off.array);
+	u->cq_head = (unsigned*) (cq + p.cq_off.head);
+	u->cq_tail = (unsigned*) (cq + p.cq_off.tail);
+	u->cq_mask = (unsigned*) (cq + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe*) (cq + p.cq_off.cqes);
+	u->sq_local = *u->sq_tail;
+}
+
+void uio_destroy(uio_t *u) {
+	if(!u->fallback) {
+		munmap(u->sqes, u->entries * sizeof(struct io_uring_sqe));
+		if(u->cq_ring != u->sq_ring)
+			munmap(u->cq_ring, u->cq_ring_sz);
+		munmap(u->sq_ring, u->sq_ring_sz);
+		close(u->ring_fd);
+	}
+	free(u->files);
+	free(u->bufs);
+	free(u->fq);
+}
+
+// Both tables are copied; the buffers themselves must outlive u.
+int uio_register_files(uio_t *u, const int *fds, int n) {
+	u->files = malloc(n * sizeof(int));
+	assert(u->files != NULL);
+	memcpy(u->files, fds, n * sizeof(int));
+	u->nfiles = n;
+	if(u->fallback)
+		return 0;
+	return (int) syscall(__NR_io_uring_register, u->ring_fd, IORING_REGISTER_FILES, fds, n);
+}
+
+int uio_register_buffers(uio_t *u, const struct iovec *iov, int n) {
+	u->bufs = malloc(n * sizeof(struct iovec));
+	assert(u->bufs != NULL);
+	memcpy(u->bufs, iov, n * sizeof(struct iovec));
+	u->nbufs = n;
+	if(u->fallback)
+		return 0;
+	return (int) syscall(__NR_io_uring_register, u->ring_fd, IORING_REGISTER_BUFFERS, iov, n);
+}
+
+int uio_buf_index(uio_t *u, const void *buf, size_t len) {
+	for(int i = 0; i < u->nbufs; i++) {
+		char *b = u->bufs[i].iov_base;
+		if((char*) buf >= b && (char*) buf + len <= b + u->bufs[i].iov_len)
+			return i;
+	}
+	assert(0);	// UIO_FIXED_BUF on a buffer that was never registered
+	return -1;
+}
+
+// Hand the queued operations to the kernel and wait for at least wait_nr
+// completions. Returns the number submitted.
+int uio_submit(uio_t *u, unsigned wait_nr) {
+	if(u->fallback)
+		return 0;
+	unsigned n = u->sq_local - *u->sq_tail;
+	__atomic_store_n(u->sq_tail, u->sq_local, __ATOMIC_RELEASE);
+	if(n == 0 && wait_nr == 0)
+		return 0;
+	int rc;
+	do {
+		rc = uio_enter(u, n, wait_nr);
+	} while(rc < 0 && errno == EINTR);
+	assert(rc >= 0);
+	return rc;
+}
+
+// Run an operation now (fallback mode) and post its completion.
+void uio_run(uio_t *u, int op, int fd, void *buf, unsigned len, off_t off, long ud, int flags) {
+	int res;
+	if(u->link_broken) {
+		res = -ECANCELED;
+	} else {
+		u->enters++;
+		if(op == IORING_OP_READ)
+			res = pread(fd, buf, len, off);
+		else if(op == IORING_OP_WRITE)
+			res = pwrite(fd, buf, len, off);
+		else
+			res = fdatasync(fd);
+		if(res < 0)
+			res = -errno;
+	}
+	if(flags & UIO_LINK)
+		u->link_broken = res < 0 || (op != IORING_OP_FSYNC && res != (int) len);
+	else
+		u->link_broken = 0;
+	uio_cqe_t *c = &u->fq[u->fq_tail++ % (2 * u->entries)];
+	c->ud = ud;
+	c->res = res;
+}
+
+void uio_prep(uio_t *u, int op, int fd, void *buf, unsigned len, off_t off, long ud, int flags) {
+	if(u->fallback) {
+		assert(u->fq_tail - u->fq_head < 2 * u->entries);
+		uio_run(u, op, flags & UIO_FIXED_FILE ? u->files[fd] : fd, buf, len, off, ud, flags);
+		return;
+	}
+	if(u->sq_local - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) == u->entries)
+		uio_submit(u, 0);	// the kernel takes them all before returning
+	struct io_uring_sqe *s = &u->sqes[u->sq_local & *u->sq_mask];
+	memset(s, 0, sizeof(*s));
+	s->fd = fd;
+	s->off = off;
+	s->addr = (unsigned long) buf;
+	s->len = len;
+	s->user_data = ud;
+	if(flags & UIO_LINK)
+		s->flags |= IOSQE_IO_LINK;
+	if(flags & UIO_FIXED_FILE)
+		s->flags |= IOSQE_FIXED_FILE;
+	if(op == IORING_OP_FSYNC) {
+		s->fsync_flags = IORING_FSYNC_DATASYNC;
+	} else if(flags & UIO_FIXED_BUF) {
+		op = op == IORING_OP_READ ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+		s->buf_index = uio_buf_index(u, buf, len);
+	}
+	s->opcode = op;
+	u->sq_array[u->sq_local & *u->sq_mask] = u->sq_local & *u->sq_mask;
+	u->sq_local++;
+}
+
+void uio_read(uio_t *u, int fd, void *buf, unsigned len, off_t off, long ud, int flags) {
+	uio_prep(u, IORING_OP_READ, fd, buf, len, off, ud, flags);
+}
+
+void uio_write(uio_t *u, int fd, const void *buf, unsigned len, off_t off, long ud, int flags) {
+	uio_prep(u, IORING_OP_WRITE, fd, (void*) buf, len, off, ud, flags);
+}
+
+// fdatasync, ordered after earlier operations only if they are linked to it.
+void uio_fsync(uio_t *u, int fd, long ud, int flags) {
+	uio_prep(u, IORING_OP_FSYNC, fd, NULL, 0, 0, ud, flags);
+}
+
+// Take one completion if there is one. Returns 0 if there is none.
+int uio_peek(uio_t *u, uio_cqe_t *out) {
+	if(u->fallback) {
+		if(u->fq_head == u->fq_tail)
+			return 0;
+		*out = u->fq[u->fq_head++ % (2 * u->entries)];
+		return 1;
+	}
+	unsigned head = *u->cq_head;
+	if(head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE))
+		return 0;
+	struct io_uring_cqe *c = &u->cqes[head & *u->cq_mask];
+	out->ud = c->user_data;
+	out->res = c->res;
+	__atomic_store_n(u->cq_head, head + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+// Take one completion, submitting queued operations and waiting if needed.
+void uio_wait(uio_t *u, uio_cqe_t *out) {
+	while(!uio_peek(u, out)) {
+		assert(!u->fallback);	// nothing in flight would ever complete
+		uio_submit(u, 1);
+	}
+}
+
+#endif // __uring_h__
@@ -0,0 +1,85 @@
+#ifndef __arena_h__
+#define __arena_h__
+
+// Arena (bump) allocator for short-lived scratch memory.
+//
+// arena_init reserves a big range of virtual memory with one mmap. Nothing
+// is committed up front: the kernel only backs a page with RAM the first time
+// it is touched, so reserved-but-untouched space costs nothing, just as the
+// untouched parts of each 4 MB malloc in leak.c cost nothing.
+//
+// arena_alloc bumps a pointer (O(1), no locking, no headers) and arena_reset
+// rewinds it (O(1)), freeing everything at once. By default reset keeps the
+// pages so the next round reuses them without page faults; with
+// ARENA_RELEASE it also hands them back to the kernel (MADV_DONTNEED).
+// ARENA_HUGE asks for transparent huge pages (MADV_HUGEPAGE), which cuts
+// page faults and TLB misses by 512x when the arena is used densely.
+//
+// Not thread-safe: use one arena per thread (or per request).
+
+#include <stddef.h>
+#include <stdint.h>
+#include <assert.h>
+#include <sys/mman.h>
+
+#define ARENA_HUGE 1
+#define ARENA_RELEASE 2
+#define HUGE_PAGE (2UL << 20)
+
+typedef struct _arena_t {
+	char *base;
+	size_t size;		// reserved bytes
+	size_t used;
+	size_t high;		// most ever used since the last release
+	int flags;
+} arena_t;
+
+int arena_init(arena_t *a, size_t size, int flags) {
+	size = (size + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1);
+	// Reserve one extra huge page so base can be aligned for THP.
+	char *p = mmap(NULL, size + HUGE_PAGE, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(p == MAP_FAILED)
+		return -1;
+	char *base = (char*) (((uintptr_t) p + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1));
+	if(base > p)
+		munmap(p, base - p);
+	munmap(base + size, (p + HUGE_PAGE) - base);
+	if(flags & ARENA_HUGE)
+		madvise(base, size, MADV_HUGEPAGE);
+	a->base = base;
+	a->size = size;
+	a->used = 0;
+	a->high = 0;
+	a->flags = flags;
+	return 0;
+}
+
+void arena_destroy(arena_t *a) {
+	munmap(a->base, a->size);
+}
+
+// Returns NULL when the reservation is used up. align must be a power of 2.
+void *arena_alloc_aligned(arena_t *a, size_t n, size_t align) {
+	size_t off = (a->used + align - 1) & ~(align - 1);
+	if(off + n > a->size)
+		return NULL;
+	a->used = off + n;
+	return a->base + off;
+}
+
+void *arena_alloc(arena_t *a, size_t n) {
+	return arena_alloc_aligned(a, n, 16);
+}
+
+void arena_reset(arena_t *a) {
+	if(a->used > a->high)
+		a->high = a->used;
+	a->used = 0;
+	if(a->flags & ARENA_RELEASE) {
+		madvise(a->base, a->high, MADV_DONTNEED);
+		a->high = 0;
+	}
+}
+
+#endif // __arena_h__
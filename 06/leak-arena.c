@@ -0,0 +1,84 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+#include<sys/time.h>
+#include<sys/wait.h>
+#include<sys/resource.h>
+#include "arena.h"
+
+// leak.c's loop (allocate 1M ints, touch every 4096th) done five ways:
+//   leak          malloc and never free, as in leak.c
+//   malloc/free   malloc and free every iteration
+//   arena         one arena, reset every iteration
+//   arena+release same, but reset gives the pages back to the kernel
+//   arena+huge    arena backed by transparent huge pages
+// Each mode runs in its own child so peak RSS is per mode. We report the
+// mean time per allocation call, the time per iteration including the page
+// faults of touching the memory, and peak RSS. leak keeps 4 MB per
+// iteration, so it stops after LEAK_MAX iterations (4 GB of address space).
+//
+// usage: leak-arena [iterations]
+
+#define N 1000000
+#define LEAK_MAX 1000
+
+double now() {
+	struct timeval t;
+	gettimeofday(&t, NULL);
+	return t.tv_sec + t.tv_usec / 1e6;
+}
+
+const char *names[] = { "leak", "malloc/free", "arena", "arena+release", "arena+huge" };
+
+void run(int mode, int iters) {
+	arena_t a;
+	if(mode >= 2)
+		assert(arena_init(&a, N * sizeof(int),
+				mode == 3 ? ARENA_RELEASE : mode == 4 ? ARENA_HUGE : 0) == 0);
+	if(mode == 0 && iters > LEAK_MAX)
+		iters = LEAK_MAX;
+	double alloc = 0, start = now();
+	long long sum = 0;
+	for(int i = 0; i < iters; i++) {
+		double t = now();
+		int* x = mode >= 2 ? arena_alloc(&a, N * sizeof(int)) : (int*) malloc(N * sizeof(int));
+		alloc += now() - t;
+		if(x == NULL) {
+			printf("oops! %s: out of memory after %d iterations\n", names[mode], i);
+			exit(-1);
+		}
+		for(int j = 0; j < N; j+=4096)
+			x[j] = j;
+		sum += x[4096];
+		if(mode == 1)
+			free(x);
+		else if(mode >= 2)
+			arena_reset(&a);
+	}
+	double total = now() - start;
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	printf("%-14s %12.3f %12.3f %10ld (%lld)\n", names[mode], alloc / iters * 1e6,
+			total / iters * 1e6, ru.ru_maxrss / 1024, sum);
+}
+
+int main(int argc, char** argv) {
+	int iters = argc > 1 ? atoi(argv[1]) : 1000;
+	printf("%-14s %12s %12s %10s\n", "mode", "alloc us", "iter us", "peak MB");
+	fflush(stdout);
+	for(int mode = 0; mode < 5; mode++) {
+		int rc = fork();
+		if(rc == 0) {
+			run(mode, iters);
+			exit(0);
+		}
+		int status;
+		waitpid(rc, &status, 0);
+		if(WIFSIGNALED(status))
+			printf("oops! %s killed by signal %d\n", names[mode], WTERMSIG(status));
+		else if(WEXITSTATUS(status) != 0)
+			printf("oops! %s exited with status %d\n", names[mode], WEXITSTATUS(status));
+	}
+	return 0;
+}
@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+// fork-cow.c with the copy-on-write costs made visible.
+//
+// The parent fills an array of <MB> megabytes and forks. The child writes
+// every element, a slice at a time, and after each slice reports the page
+// faults it took (getrusage), the time per fault beyond what the same
+// writes cost without faults, and the array's RSS, private dirty and huge
+// page memory (/proc/self/smaps). The parent then waits and rewrites the
+// array once more, now that its pages are no longer shared.
+//
+// The mode decides how the array is backed:
+//   plain       madvise nothing (THP only if the system enables it always)
+//   thp         MADV_HUGEPAGE: 2 MB pages, so fork copies 512 times fewer
+//               page table entries (a COW fault still splits the huge page
+//               and copies 4 KB of it, at least on recent kernels)
+//   nothp       MADV_NOHUGEPAGE: always 4 KB pages
+//   dontfork    MADV_DONTFORK: the child does not get the array at all
+//   wipeonfork  MADV_WIPEONFORK: the child gets it zero-filled, not shared
+//
+// usage: cow-prof [plain|thp|nothp|dontfork|wipeonfork] [MB] [slices]
+
+#define HUGE (2L << 20)
+
+double now() {
+	struct timeval t;
+	gettimeofday(&t, NULL);
+	return t.tv_sec + t.tv_usec / 1e6;
+}
+
+long minflt() {
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_minflt;
+}
+
+typedef struct _region_t {
+	long rss, dirty, huge;		// kB
+} region_t;
+
+// The smaps entry of the mapping that contains base.
+void region(void *base, region_t *r) {
+	char line[256];
+	FILE *f = fopen("/proc/self/smaps", "r");
+	assert(f != NULL);
+	memset(r, 0, sizeof(region_t));
+	int in = 0;
+	while(fgets(line, sizeof(line), f) != NULL) {
+		unsigned long start, end;
+		if(sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+			// A mapping header: "start-end perms offset dev inode path".
+			in = start <= (unsigned long) base && (unsigned long) base < end;
+			continue;
+		}
+		if(!in)
+			continue;
+		sscanf(line, "Rss: %ld", &r->rss);
+		sscanf(line, "Private_Dirty: %ld", &r->dirty);
+		sscanf(line, "AnonHugePages: %ld", &r->huge);
+	}
+	fclose(f);
+}
+
+// Write every int of a[0..n) and return the time taken.
+double fill(int *a, long n, int v) {
+	double t = now();
+	for(long i = 0; i < n; i++)
+		a[i] = v;
+	return now() - t;
+}
+
+// Write a in slices, reporting after each one.
+void profile(const char *who, int *a, long n, int slices, int v, double base) {
+	printf("%s:\n%6s %10s %12s %10s %10s %10s\n", who, "slice", "faults",
+			"us/fault", "RSS MB", "dirty MB", "huge MB");
+	long step = n / slices, total = 0;
+	double t0 = now();
+	for(int s = 0; s < slices; s++) {
+		long f = minflt();
+		double t = fill(a + s * step, s == slices - 1 ? n - s * step : step, v);
+		f = minflt() - f;
+		total += f;
+		region_t r;
+		region(a, &r);
+		printf("%6d %10ld %12.2f %10ld %10ld %10ld\n", s, f,
+				f > 0 ? (t - base / slices) / f * 1e6 : 0, r.rss / 1024, r.dirty / 1024, r.huge / 1024);
+	}
+	printf("%s total: %ld faults, %.1f ms (%.1f ms without faults)\n", who, total,
+			(now() - t0) * 1e3, base * 1e3);
+	fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+	const char *mode = argc > 1 ? argv[1] : "plain";
+	long mb = argc > 2 ? atol(argv[2]) : 400;
+	int slices = argc > 3 ? atoi(argv[3]) : 8;
+	long size = mb << 20, n = size / sizeof(int);
+
+	// Align to a huge page so THP can back all of it.
+	char *p = mmap(NULL, size + HUGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	assert(p != MAP_FAILED);
+	int *a = (int*) (((unsigned long) p + HUGE - 1) & ~(HUGE - 1));
+	int advice = -1;
+	if(strcmp(mode, "thp") == 0)
+		advice = MADV_HUGEPAGE;
+	else if(strcmp(mode, "nothp") == 0)
+		advice = MADV_NOHUGEPAGE;
+	else if(strcmp(mode, "dontfork") == 0)
+		advice = MADV_DONTFORK;
+	else if(strcmp(mode, "wipeonfork") == 0)
+		advice = MADV_WIPEONFORK;
+	else if(strcmp(mode, "plain") != 0) {
+		printf("oops! unknown mode %s\n", mode);
+		exit(-1);
+	}
+	if(advice >= 0 && madvise(a, size, advice) != 0) {
+		perror("madvise");
+		exit(-1);
+	}
+
+	long f = minflt();
+	double t = fill(a, n, 2);
+	region_t r;
+	region(a, &r);
+	printf("%s, %ld MB: first touch %ld faults, %.1f ms; RSS %ld MB, huge %ld MB\n",
+			mode, mb, minflt() - f, t * 1e3, r.rss / 1024, r.huge / 1024);
+	double base = fill(a, n, 3);	// no faults now: the cost of the writes alone
+
+	fflush(stdout);
+	t = now();
+	int rc = fork();
+	if(rc < 0) {
+		fprintf(stderr, "fork failed\n");
+		exit(1);
+	} else if(rc == 0) {
+		if(advice == MADV_DONTFORK) {
+			// The array is not mapped here; touching it would segfault.
+			region(a, &r);
+			printf("child: array not inherited (RSS %ld MB)\n", r.rss / 1024);
+			exit(0);
+		}
+		if(advice == MADV_WIPEONFORK)
+			printf("child: a[0] = %d after fork\n", a[0]);
+		profile("child", a, n, slices, 1, base);
+		exit(0);
+	}
+	t = now() - t;
+	waitpid(rc, NULL, 0);
+	printf("fork took %.2f ms\n", t * 1e3);
+	profile("parent after child exit", a, n, slices, 4, base);
+	return 0;
+}
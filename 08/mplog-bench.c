@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "mplog.h"
+
+// Lines per second into one log file from 1 to 64 processes, each writing
+// its share of <lines> lines:
+//   shared   one write per line to an fd inherited from the parent, as in
+//            fork-fd.c (one shared offset)
+//   own      one write per line to the process's own open of the file, as
+//            in nodup.c; the offsets collide and lines are overwritten
+//   batched  lg_open: private buffer, O_APPEND writev batches
+//   central  lg_connect: batches through pipes to a lg_serve process
+// Afterwards the file is read back and every line checked; lost lines are
+// only expected with own.
+//
+// usage: mplog-bench [lines]
+
+#define LOG "mplog.txt"
+#define SOCK "mplog.sock"
+
+const char *names[] = { "shared", "own", "batched", "central" };
+
+double now() {
+	struct timeval t;
+	gettimeofday(&t, NULL);
+	return t.tv_sec + t.tv_usec / 1e6;
+}
+
+int line(char *buf, int w, long i) {
+	return sprintf(buf, "worker %d line %ld: the quick brown fox jumps over the lazy dog\n", w, i);
+}
+
+void worker(int method, int w, long lines, int shared) {
+	char buf[128];
+	lg_t l;
+	if(method == 2)
+		lg_open(&l, LOG, LG_BUF);
+	else if(method == 3 && lg_connect(&l, SOCK, LG_BUF) < 0) {
+		printf("oops! cannot connect to the log writer\n");
+		exit(-1);
+	}
+	int fd = method == 0 ? shared : method == 1 ? open(LOG, O_WRONLY) : -1;
+	for(long i = 0; i < lines; i++) {
+		int n = line(buf, w, i);
+		if(method >= 2)
+			lg_write(&l, buf, n);
+		else if(write(fd, buf, n) != n)
+			exit(1);
+	}
+	if(method >= 2)
+		lg_close(&l);
+	exit(0);
+}
+
+// Number of intact, distinct lines in the log.
+long count(int procs, long lines) {
+	FILE *f = fopen(LOG, "r");
+	char *seen = calloc(procs * lines, 1), buf[256], want[128];
+	long ok = 0;
+	int w;
+	long i;
+	while(fgets(buf, sizeof(buf), f) != NULL)
+		if(sscanf(buf, "worker %d line %ld", &w, &i) == 2 && w >= 0 && w < procs &&
+				i >= 0 && i < lines && !seen[w * lines + i]) {
+			line(want, w, i);
+			if(strcmp(buf, want) == 0) {
+				seen[w * lines + i] = 1;
+				ok++;
+			}
+		}
+	fclose(f);
+	free(seen);
+	return ok;
+}
+
+double run(int method, int procs, long lines, long *ok) {
+	int shared = open(LOG, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+	pid_t server = -1;
+	fflush(stdout);
+	double t = now();
+	if(method == 3) {
+		int ready[2];
+		if(pipe(ready) < 0)
+			exit(-1);
+		server = fork();
+		if(server == 0) {
+			lg_serve(SOCK, LOG, ready[1]);
+			exit(0);
+		}
+		char c;
+		if(read(ready[0], &c, 1) != 1)
+			exit(-1);
+		close(ready[0]);
+		close(ready[1]);
+	}
+	for(int w = 0; w < procs; w++)
+		if(fork() == 0)
+			worker(method, w, lines, shared);
+	int status;
+	for(int w = 0; w < procs; w++)
+		if(wait(&status) < 0 || status != 0) {
+			printf("oops! a writer failed\n");
+			exit(-1);
+		}
+	if(method == 3) {
+		lg_stop(SOCK);
+		waitpid(server, NULL, 0);
+	}
+	t = now() - t;
+	close(shared);
+	*ok = count(procs, lines);
+	if(method != 1 && *ok != procs * lines) {
+		printf("oops! %s: %ld of %ld lines intact\n", names[method], *ok, procs * lines);
+		exit(-1);
+	}
+	return procs * lines / t;
+}
+
+int main(int argc, char *argv[]) {
+	long total = argc > 1 ? atol(argv[1]) : 256 * 1024;
+	printf("%6s %10s %10s %8s %10s %10s   (lines/s)\n", "procs", names[0], names[1],
+			"own lost", names[2], names[3]);
+	for(int procs = 1; procs <= 64; procs *= 2) {
+		long lines = total / procs, ok;
+		printf("%6d", procs);
+		for(int m = 0; m < 4; m++) {
+			double r = run(m, procs, lines, &ok);
+			printf(" %10.0f", r);
+			if(m == 1)
+				printf(" %7.1f%%", 100.0 * (procs * lines - ok) / (procs * lines));
+			fflush(stdout);
+		}
+		printf("\n");
+	}
+	unlink(LOG);
+	return 0;
+}
@@ -0,0 +1,312 @@
+#ifndef __mplog_h__
+#define __mplog_h__
+
+// A log that many processes append to.
+//
+// fork-fd.c and dup.c share one open file, and so one offset, between
+// writers; nodup.c opens the file twice, and the two offsets overwrite each
+// other. A service whose workers each write their lines straight to a
+// shared fd gets neither problem, but pays a system call per line. Here
+// each worker collects lines in a private buffer and hands a whole batch of
+// them to the kernel at once, in one of two ways:
+//
+//   lg_open     the worker opens the log O_APPEND itself and flushes with
+//               writev. Each writev goes to the end of the file as one
+//               piece, so batches of different workers never mix.
+//   lg_connect  the worker makes a pipe and sends its read end over a Unix
+//               socket (SCM_RIGHTS) to a central writer process running
+//               lg_serve, which is then the only one writing the file: it
+//               gathers whole lines from all pipes and writes them out with
+//               one writev per round.
+//
+// Lines are only ever flushed whole, so a batch never ends mid-line. Lines
+// longer than LG_BUF work too, but in central mode the writer then
+// serves that one pipe until the line is complete.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define LG_BUF (64 * 1024)
+#define LG_MAXFD 256		// pipes a central writer can serve
+
+typedef struct _lg_t {
+	int fd;
+	char *buf;
+	size_t used, size;
+	long flushes;
+} lg_t;
+
+void lg_init(lg_t *l, int fd, size_t size) {
+	l->fd = fd;
+	l->size = size;
+	l->used = 0;
+	l->flushes = 0;
+	l->buf = malloc(size);
+	assert(l->buf != NULL);
+}
+
+// Write iov[0..n-1] completely.
+int lg_writev(int fd, struct iovec *iov, int n) {
+	while(n > 0) {
+		ssize_t w = writev(fd, iov, n);
+		if(w < 0 && errno == EINTR)
+			continue;
+		if(w < 0)
+			return -1;
+		while(n > 0 && (size_t) w >= iov->iov_len) {
+			w -= iov->iov_len;
+			iov++;
+			n--;
+		}
+		if(n > 0) {
+			iov->iov_base = (char*) iov->iov_base + w;
+			iov->iov_len -= w;
+		}
+	}
+	return 0;
+}
+
+// Append to path, creating it if needed. Returns 0, or -1 with errno set.
+int lg_open(lg_t *l, const char *path, size_t size) {
+	int fd = open(path, O_WRONLY | O_APPEND | O_CREAT, S_IRUSR | S_IWUSR);
+	if(fd < 0)
+		return -1;
+	lg_init(l, fd, size);
+	return 0;
+}
+
+// Log through the central writer listening on sock (see lg_serve).
+int lg_connect(lg_t *l, const char *sock, size_t size) {
+	int p[2];
+	if(pipe(p) < 0)
+		return -1;
+	int s = socket(AF_UNIX, SOCK_STREAM, 0);
+	struct sockaddr_un a = { .sun_family = AF_UNIX };
+	strncpy(a.sun_path, sock, sizeof(a.sun_path) - 1);
+	if(s < 0 || connect(s, (struct sockaddr*) &a, sizeof(a)) < 0) {
+		if(s >= 0)
+			close(s);
+		close(p[0]);
+		close(p[1]);
+		return -1;
+	}
+	char byte = 'L', ctl[CMSG_SPACE(sizeof(int))];
+	struct iovec iov = { &byte, 1 };
+	struct msghdr m = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = ctl, .msg_controllen = sizeof(ctl) };
+	struct cmsghdr *c = CMSG_FIRSTHDR(&m);
+	c->cmsg_level = SOL_SOCKET;
+	c->cmsg_type = SCM_RIGHTS;
+	c->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(c), &p[0], sizeof(int));
+	int rc = sendmsg(s, &m, 0);
+	close(s);
+	close(p[0]);
+	if(rc != 1) {
+		close(p[1]);
+		return -1;
+	}
+	lg_init(l, p[1], size);
+	return 0;
+}
+
+// Write out the buffer and then extra (a line too big for it), together.
+void lg_flush_with(lg_t *l, const char *extra, size_t n) {
+	struct iovec iov[2] = { { l->buf, l->used }, { (void*) extra, n } };
+	if(l->used + n == 0)
+		return;
+	assert(lg_writev(l->fd, l->used > 0 ? iov : iov + 1, (l->used > 0) + (n > 0)) == 0);
+	l->flushes++;
+	l->used = 0;
+}
+
+void lg_flush(lg_t *l) {
+	lg_flush_with(l, NULL, 0);
+}
+
+// Append one line of n bytes, newline included.
+void lg_write(lg_t *l, const char *line, size_t n) {
+	if(l->used + n <= l->size) {
+		memcpy(l->buf + l->used, line, n);
+		l->used += n;
+	} else if(n <= l->size) {
+		lg_flush(l);
+		memcpy(l->buf, line, n);
+		l->used = n;
+	} else {
+		lg_flush_with(l, line, n);
+	}
+}
+
+// printf one line (the caller supplies the newline) into the buffer.
+void lg_printf(lg_t *l, const char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	int n = vsnprintf(l->buf + l->used, l->size - l->used, fmt, ap);
+	va_end(ap);
+	assert(n >= 0);
+	if(l->used + n < l->size) {
+		l->used += n;
+		return;
+	}
+	char *tmp = malloc(n + 1);
+	assert(tmp != NULL);
+	va_start(ap, fmt);
+	vsnprintf(tmp, n + 1, fmt, ap);
+	va_end(ap);
+	lg_write(l, tmp, n);
+	free(tmp);
+}
+
+void lg_close(lg_t *l) {
+	lg_flush(l);
+	close(l->fd);
+	free(l->buf);
+}
+
+// A line longer than LG_BUF filled buf; write it out and keep reading fd
+// until its newline, so it still goes into the log in one piece, ahead of
+// anything else. Leaves in buf whatever followed the newline.
+void lg_long_line(int out, int fd, char *buf, size_t *have) {
+	struct iovec iov = { buf, *have };
+	assert(lg_writev(out, &iov, 1) == 0);
+	for(;;) {
+		ssize_t r = read(fd, buf, LG_BUF);
+		if(r < 0 && errno == EINTR)
+			continue;
+		if(r <= 0) {
+			// The writer went away mid-line: end the line for it.
+			*have = 0;
+			assert(write(out, "\n", 1) == 1);
+			return;
+		}
+		char *nl = memchr(buf, '\n', r);
+		iov.iov_base = buf;
+		iov.iov_len = nl != NULL ? nl + 1 - buf : r;
+		assert(lg_writev(out, &iov, 1) == 0);
+		if(nl != NULL) {
+			*have = r - (nl + 1 - buf);
+			memmove(buf, nl + 1, *have);
+			return;
+		}
+	}
+}
+
+// The central writer: listen on sock and append everything that arrives on
+// the pipes sent to it to path, whole lines at a time. A connection that
+// sends no fd asks it to finish: it drains the pipes it has until their
+// writers close them, then returns. ready (if >= 0) gets a byte once it is
+// listening.
+void lg_serve(const char *sock, const char *path, int ready) {
+	int out = open(path, O_WRONLY | O_APPEND | O_CREAT, S_IRUSR | S_IWUSR);
+	int ls = socket(AF_UNIX, SOCK_STREAM, 0);
+	assert(out >= 0 && ls >= 0);
+	struct sockaddr_un a = { .sun_family = AF_UNIX };
+	strncpy(a.sun_path, sock, sizeof(a.sun_path) - 1);
+	unlink(sock);
+	assert(bind(ls, (struct sockaddr*) &a, sizeof(a)) == 0 && listen(ls, 128) == 0);
+	if(ready >= 0)
+		assert(write(ready, "", 1) == 1);
+
+	// pfd[0] is the listening socket, the rest are pipes; each pipe has a
+	// buffer holding what came after its last newline.
+	struct pollfd pfd[LG_MAXFD + 1];
+	char *buf[LG_MAXFD + 1];
+	size_t have[LG_MAXFD + 1], cut[LG_MAXFD + 1];
+	struct iovec iov[LG_MAXFD];
+	int n = 1, stopping = 0;
+	pfd[0].fd = ls;
+	pfd[0].events = POLLIN;
+	while(n > 1 || !stopping) {
+		if(poll(pfd, n, -1) < 0) {
+			assert(errno == EINTR);
+			continue;
+		}
+		if(pfd[0].revents & POLLIN) {
+			int s = accept(ls, NULL, NULL);
+			char byte, ctl[CMSG_SPACE(sizeof(int))];
+			struct iovec v = { &byte, 1 };
+			struct msghdr m = { .msg_iov = &v, .msg_iovlen = 1, .msg_control = ctl, .msg_controllen = sizeof(ctl) };
+			struct cmsghdr *c;
+			if(s >= 0 && recvmsg(s, &m, 0) == 1 && (c = CMSG_FIRSTHDR(&m)) != NULL &&
+					c->cmsg_type == SCM_RIGHTS) {
+				assert(n <= LG_MAXFD);
+				memcpy(&pfd[n].fd, CMSG_DATA(c), sizeof(int));
+				pfd[n].events = POLLIN;
+				pfd[n].revents = 0;
+				buf[n] = malloc(LG_BUF);
+				assert(buf[n] != NULL);
+				have[n++] = 0;
+			} else {
+				stopping = 1;
+				pfd[0].fd = -1;		// no more connections
+			}
+			close(s);
+		}
+		int nv = 0;
+		for(int i = 1; i < n; i++) {
+			cut[i] = 0;
+			if(pfd[i].revents == 0)
+				continue;
+			ssize_t r = read(pfd[i].fd, buf[i] + have[i], LG_BUF - have[i]);
+			if(r <= 0) {
+				// Writer gone; a last partial line is dropped.
+				close(pfd[i].fd);
+				pfd[i].fd = -1;
+				continue;
+			}
+			have[i] += r;
+			if(have[i] == LG_BUF && memchr(buf[i], '\n', LG_BUF) == NULL)
+				lg_long_line(out, pfd[i].fd, buf[i], &have[i]);
+			size_t end = have[i];
+			while(end > 0 && buf[i][end - 1] != '\n')
+				end--;
+			cut[i] = end;
+			iov[nv].iov_base = buf[i];
+			iov[nv++].iov_len = end;
+		}
+		if(nv > 0)
+			assert(lg_writev(out, iov, nv) == 0);
+		// Keep what followed the last newline; drop the closed pipes.
+		for(int i = 1; i < n; i++) {
+			memmove(buf[i], buf[i] + cut[i], have[i] - cut[i]);
+			have[i] -= cut[i];
+			if(pfd[i].fd < 0) {
+				free(buf[i]);
+				n--;
+				pfd[i] = pfd[n];
+				buf[i] = buf[n];
+				have[i] = have[n];
+				cut[i] = cut[n];
+				i--;
+			}
+		}
+	}
+	close(ls);
+	unlink(sock);
+	close(out);
+}
+
+// Ask the central writer on sock to finish (see lg_serve).
+int lg_stop(const char *sock) {
+	int s = socket(AF_UNIX, SOCK_STREAM, 0);
+	struct sockaddr_un a = { .sun_family = AF_UNIX };
+	strncpy(a.sun_path, sock, sizeof(a.sun_path) - 1);
+	if(s < 0 || connect(s, (struct sockaddr*) &a, sizeof(a)) < 0)
+		return -1;
+	int rc = write(s, "", 1) == 1 ? 0 : -1;
+	close(s);
+	return rc;
+}
+
+#endif // __mplog_h__
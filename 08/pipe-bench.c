@@ -0,0 +1,109 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "xfer.h"
+
+// A child writes <mb> MB of lower-case text into a pipe; the parent moves
+// it to /dev/null:
+//   byte          pipe.c's loop: read 1 byte, uppercase, putchar
+//   block+upper   xfer_upper: 64 KB reads, SIMD uppercase, one write each
+//   splice        xfer_splice, no transformation
+//   vmsplice      xfer_splice, with the child using xfer_vmsplice
+//   tee           xfer_tee, with a second child draining the copy
+// The byte loop only gets <byte_mb> MB; it does a system call per byte.
+//
+// usage: pipe-bench [mb] [byte_mb]
+
+double now() {
+	struct timeval t;
+	gettimeofday(&t, NULL);
+	return t.tv_sec + t.tv_usec / 1e6;
+}
+
+char text[XFER_BLOCK];
+
+void producer(int fd, long bytes, int use_vmsplice) {
+	for(long sent = 0; sent < bytes; sent += XFER_BLOCK) {
+		int rc = use_vmsplice ? xfer_vmsplice(fd, text, XFER_BLOCK)
+				: write_all(fd, text, XFER_BLOCK);
+		assert(rc == 0);
+	}
+}
+
+// Returns bytes moved.
+long consume(int mode, int in, int out) {
+	if(mode == 0) {
+		FILE *f = fdopen(out, "w");
+		long total = 0;
+		char c;
+		while(read(in, &c, sizeof(char)) == 1) {
+			if(c >= 'a' && c <= 'z')
+				c = c - 'a' + 'A';
+			fputc(c, f);
+			total++;
+		}
+		fflush(f);
+		return total;
+	}
+	if(mode == 1)
+		return xfer_upper(in, out);
+	if(mode == 4) {
+		int q[2];
+		int rc = pipe(q);
+		assert(rc == 0);
+		if(fork() == 0) {
+			close(q[1]);
+			xfer_splice(q[0], out);
+			exit(0);
+		}
+		close(q[0]);
+		long n = xfer_tee(in, out, q[1]);
+		close(q[1]);
+		wait(NULL);
+		return n;
+	}
+	return xfer_splice(in, out);
+}
+
+int main(int argc, char *argv[]) {
+	long mb = argc > 1 ? atol(argv[1]) : 1024;
+	long byte_mb = argc > 2 ? atol(argv[2]) : 4;
+	const char *names[] = { "byte", "block+upper", "splice", "vmsplice", "tee" };
+	for(int i = 0; i < XFER_BLOCK; i++)
+		text[i] = i % 64 == 63 ? '\n' : i % 8 == 7 ? ' ' : 'a' + i % 26;
+
+	int null = open("/dev/null", O_WRONLY);
+	assert(null >= 0);
+	printf("%-12s %8s %10s\n", "mode", "MB", "MB/s");
+	fflush(stdout);		// or the children print it again
+	for(int mode = 0; mode < 5; mode++) {
+		long bytes = (mode == 0 ? byte_mb : mb) << 20;
+		int p[2];
+		int rc = pipe(p);
+		assert(rc == 0);
+		double t = now();
+		if(fork() == 0) {
+			close(p[0]);
+			producer(p[1], bytes, mode == 3);
+			exit(0);
+		}
+		close(p[1]);
+		long n = consume(mode, p[0], null);
+		close(p[0]);
+		wait(NULL);
+		t = now() - t;
+		if(n != bytes) {
+			printf("oops! %s moved %ld bytes, expected %ld\n", names[mode], n, bytes);
+			exit(-1);
+		}
+		printf("%-12s %8ld %10.1f\n", names[mode], bytes >> 20, bytes / t / (1 << 20));
+		fflush(stdout);
+	}
+	return 0;
+}
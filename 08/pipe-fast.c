@@ -0,0 +1,50 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <sys/wait.h>
+#include "xfer.h"
+
+// pipe.c, moving the data in blocks instead of a byte at a time:
+// uppercased with xfer_upper, or passed through untouched with xfer_splice
+// when run as "pipe-fast -copy".
+
+int main(int argc, char *argv[]) {
+	int p[2];
+	if(pipe(p) < 0) return -1;
+	int rc = fork();
+	if (rc < 0) {
+		// fork failed; exit
+		fprintf(stderr, "fork failed\n");
+		exit(1);
+	} else if (rc == 0) {
+		// child: redirect standard output to the pipe
+		close(STDOUT_FILENO);
+		dup(p[1]);
+		close(p[0]);
+		close(p[1]);
+
+		char *myargs[3];
+		myargs[0] = strdup("echo");
+		myargs[1] = strdup("i will get printed in capital letters!!");
+		myargs[2] = NULL;           // marks end of array
+		execvp(myargs[0], myargs);
+	} else {
+		// parent goes down this path (original process)
+		close(p[1]);
+		close(STDIN_FILENO);
+		dup(p[0]);
+		close(p[0]);
+		long n;
+		if(argc > 1 && strcmp(argv[1], "-copy") == 0)
+			n = xfer_splice(STDIN_FILENO, STDOUT_FILENO);
+		else
+			n = xfer_upper(STDIN_FILENO, STDOUT_FILENO);
+		assert(n >= 0);
+		wait(NULL);
+	}
+	return 0;
+}
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "prefork.h"
+
+// Tasks per second for busy tasks of 10 us to 10 ms, run
+//   pool        by a prefork pool of <workers> processes
+//   fork        by a forked child each, as in p1.c/p2.c
+//   fork+exec   by a forked child that execs a program for it, as in p3.c
+// Then a run where every 100th task crashes, to show the pool restarting
+// workers.
+//
+// usage: prefork-bench [workers]
+
+double now() {
+	struct timeval t;
+	gettimeofday(&t, NULL);
+	return t.tv_sec + t.tv_usec / 1e6;
+}
+
+long spin_us;
+
+double cpu() {
+	struct timespec t;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Burn spin_us of CPU time (not wall time, so workers sharing a CPU do not
+// overlap their waits) and return 2 * arg. A negative arg crashes.
+long task(long arg) {
+	if(arg < 0)
+		abort();
+	double end = cpu() + spin_us / 1e6;
+	while(cpu() < end)
+		;
+	return 2 * arg;
+}
+
+void check(long *res, long n) {
+	for(long k = 0; k < n; k++)
+		if(res[k] != 2 * k) {
+			printf("oops! task %ld returned %ld\n", k, res[k]);
+			exit(-1);
+		}
+}
+
+double run_pool(pool_t *p, long n) {
+	long *args = malloc(n * sizeof(long)), *res = malloc(n * sizeof(long));
+	for(long k = 0; k < n; k++)
+		args[k] = k;
+	double t = now();
+	pool_run(p, args, n, res);
+	t = now() - t;
+	check(res, n);
+	free(args);
+	free(res);
+	return n / t;
+}
+
+// The result comes back as the exit status, so only its low byte.
+double run_fork(long n, int exec) {
+	char us[32];
+	snprintf(us, sizeof(us), "%ld", spin_us);
+	double t = now();
+	for(long k = 0; k < n; k++) {
+		pid_t pid = fork();
+		if(pid == 0) {
+			if(exec) {
+				char arg[32];
+				snprintf(arg, sizeof(arg), "%ld", k);
+				execl("/proc/self/exe", "prefork-bench", "-task", us, arg, NULL);
+				_exit(127);
+			}
+			_exit(task(k) & 0xff);
+		}
+		int status;
+		if(pid < 0 || waitpid(pid, &status, 0) != pid || WEXITSTATUS(status) != (2 * k & 0xff)) {
+			printf("oops! task %ld failed\n", k);
+			exit(-1);
+		}
+	}
+	return n / (now() - t);
+}
+
+int main(int argc, char *argv[]) {
+	if(argc == 4 && strcmp(argv[1], "-task") == 0) {
+		// The program fork+exec runs.
+		spin_us = atol(argv[2]);
+		return task(atol(argv[3])) & 0xff;
+	}
+	int workers = argc > 1 ? atoi(argv[1]) : 4;
+
+	pool_t p;
+	pool_start(&p, workers, task);
+	printf("%8s %8s %10s %10s %10s   (tasks/s)\n", "task us", "tasks", "pool", "fork", "fork+exec");
+	for(spin_us = 10; spin_us <= 10000; spin_us *= 10) {
+		// The workers were forked before spin_us changed: restart them.
+		pool_stop(&p);
+		pool_start(&p, workers, task);
+		long n = 300000 / spin_us;
+		if(n > 2000)
+			n = 2000;
+		printf("%8ld %8ld", spin_us, n);
+		fflush(stdout);
+		printf(" %10.0f", run_pool(&p, n));
+		fflush(stdout);
+		printf(" %10.0f", run_fork(n, 0));
+		fflush(stdout);
+		printf(" %10.0f\n", run_fork(n, 1));
+	}
+
+	long n = 1000, crashed = 0;
+	long *args = malloc(n * sizeof(long)), *res = malloc(n * sizeof(long));
+	for(long k = 0; k < n; k++)
+		args[k] = k % 100 == 99 ? -1 : k;
+	pool_run(&p, args, n, res);
+	for(long k = 0; k < n; k++) {
+		if(args[k] < 0 && res[k] == POOL_CRASHED)
+			crashed++;
+		else if(res[k] != 2 * k) {
+			printf("oops! task %ld returned %ld\n", k, res[k]);
+			exit(-1);
+		}
+	}
+	printf("crash run: %ld tasks, %ld crashed, %ld workers restarted\n", n, crashed, p.restarts);
+	pool_stop(&p);
+	return 0;
+}
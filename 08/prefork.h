@@ -0,0 +1,148 @@
+#ifndef __prefork_h__
+#define __prefork_h__
+
+// A prefork worker pool.
+//
+// p1.c-p4.c fork a process for each piece of work and wait for it, paying
+// for fork, exec and exit every time. Here a supervisor forks n workers once
+// and keeps them: each is connected to it by a Unix socketpair, receives
+// tasks (a long argument) over it, runs fn on them and sends back the
+// result. SOCK_SEQPACKET keeps message boundaries, so a message is one read.
+//
+// pool_run hands out a batch of tasks to whichever workers are idle and
+// collects the results with poll. A worker that dies (a crash, an exit)
+// shows up as end of file on its socket; the supervisor reaps it with
+// waitpid, forks a replacement, and records POOL_CRASHED as the result of
+// the task it was running.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+
+#define POOL_CRASHED LONG_MIN
+
+typedef long (*pool_fn_t)(long arg);
+
+typedef struct _pool_msg_t {
+	long task;			// index into the batch
+	long val;			// argument, or result
+} pool_msg_t;
+
+typedef struct _pool_t {
+	int n;
+	pool_fn_t fn;
+	pid_t *pid;
+	int *fd;			// supervisor's end of each socketpair
+	long *task;			// task each worker is running, or -1
+	long restarts;
+} pool_t;
+
+void pool_worker(int fd, pool_fn_t fn) {
+	pool_msg_t m;
+	while(read(fd, &m, sizeof(m)) == sizeof(m)) {
+		m.val = fn(m.val);
+		if(write(fd, &m, sizeof(m)) != sizeof(m))
+			break;
+	}
+	_exit(0);
+}
+
+// (Re)start worker i.
+void pool_fork(pool_t *p, int i) {
+	int sv[2];
+	assert(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == 0);
+	fflush(stdout);
+	pid_t pid = fork();
+	assert(pid >= 0);
+	if(pid == 0) {
+		close(sv[0]);
+		for(int j = 0; j < p->n; j++)	// the other workers' sockets
+			if(j != i && p->pid[j] > 0)
+				close(p->fd[j]);
+		pool_worker(sv[1], p->fn);
+	}
+	close(sv[1]);
+	p->pid[i] = pid;
+	p->fd[i] = sv[0];
+	p->task[i] = -1;
+}
+
+void pool_start(pool_t *p, int n, pool_fn_t fn) {
+	p->n = n;
+	p->fn = fn;
+	p->pid = calloc(n, sizeof(pid_t));
+	p->fd = calloc(n, sizeof(int));
+	p->task = calloc(n, sizeof(long));
+	assert(p->pid != NULL && p->fd != NULL && p->task != NULL);
+	p->restarts = 0;
+	for(int i = 0; i < n; i++)
+		pool_fork(p, i);
+}
+
+// Worker i went away: reap it and start another in its place.
+void pool_restart(pool_t *p, int i) {
+	close(p->fd[i]);
+	while(waitpid(p->pid[i], NULL, 0) < 0 && errno == EINTR)
+		;
+	p->restarts++;
+	pool_fork(p, i);
+}
+
+// Run fn(args[k]) for k in [0, ntasks) on the workers, results into res.
+void pool_run(pool_t *p, const long *args, long ntasks, long *res) {
+	struct pollfd pfd[p->n];
+	long next = 0, done = 0;
+	while(done < ntasks) {
+		for(int i = 0; i < p->n && next < ntasks; i++) {
+			if(p->task[i] >= 0)
+				continue;
+			pool_msg_t m = { next, args[next] };
+			if(send(p->fd[i], &m, sizeof(m), MSG_NOSIGNAL) != sizeof(m)) {
+				pool_restart(p, i);	// died while idle; try again
+				i--;
+				continue;
+			}
+			p->task[i] = next++;
+		}
+		for(int i = 0; i < p->n; i++) {
+			pfd[i].fd = p->task[i] >= 0 ? p->fd[i] : -1;
+			pfd[i].events = POLLIN;
+		}
+		if(poll(pfd, p->n, -1) < 0) {
+			assert(errno == EINTR);
+			continue;
+		}
+		for(int i = 0; i < p->n; i++) {
+			if(pfd[i].revents == 0)
+				continue;
+			pool_msg_t m;
+			if(read(p->fd[i], &m, sizeof(m)) == sizeof(m)) {
+				res[m.task] = m.val;
+			} else {
+				res[p->task[i]] = POOL_CRASHED;
+				pool_restart(p, i);
+			}
+			p->task[i] = -1;
+			done++;
+		}
+	}
+}
+
+// Close the sockets; the workers see end of file and exit.
+void pool_stop(pool_t *p) {
+	for(int i = 0; i < p->n; i++)
+		close(p->fd[i]);
+	for(int i = 0; i < p->n; i++)
+		waitpid(p->pid[i], NULL, 0);
+	free(p->pid);
+	free(p->fd);
+	free(p->task);
+}
+
+#endif // __prefork_h__
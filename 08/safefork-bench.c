@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "safefork.h"
+
+// Fork latency (fork, child _exit, waitpid) with <streams> open FILEs:
+// half are being written, one in 8 of those with output pending at each
+// fork, and half are being read. Before each fork:
+//   none         nothing (the child duplicates pending output)
+//   fflush(NULL) flush all streams
+//   fflush each  fflush every stream in turn, as a careful caller would
+//   sf_fork      flush only the tracked streams with output pending
+//   SF_EXEC      flush nothing; the child drops its copies
+// First checks that sf_fork, with and without SF_EXEC, writes nothing twice
+// when the child exits with exit().
+//
+// usage: safefork-bench [forks]
+
+#define NONE 0
+#define ALL 1
+#define EACH 2
+#define SF 3
+#define SFEXEC 4
+
+double now() {
+	struct timeval t;
+	gettimeofday(&t, NULL);
+	return t.tv_sec + t.tv_usec / 1e6;
+}
+
+// fork-fd2.c: the parent's line must be in the file once, the child's once.
+void check(int flags) {
+	FILE *f = fopen("safefork.txt", "w");
+	sf_track(f);
+	fprintf(f, "hello world\n");
+	pid_t pid = sf_fork(flags);
+	if(pid == 0) {
+		fprintf(f, "hi, I am the child\n");
+		fclose(f);
+		exit(0);		// as after a failed exec
+	}
+	waitpid(pid, NULL, 0);
+	sf_untrack(f);
+	fclose(f);
+	char buf[256];
+	f = fopen("safefork.txt", "r");
+	size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+	buf[n] = 0;
+	fclose(f);
+	// With SF_EXEC the parent's line stays in its buffer until fclose.
+	const char *want = flags & SF_EXEC ? "hi, I am the child\nhello world\n" :
+			"hello world\nhi, I am the child\n";
+	if(strcmp(buf, want) != 0) {
+		printf("oops! sf_fork(%d) wrote:\n%s", flags, buf);
+		exit(-1);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	int forks = argc > 1 ? atoi(argv[1]) : 2000;
+	const char *names[] = { "none", "fflush(NULL)", "fflush each", "sf_fork", "SF_EXEC" };
+	check(0);
+	check(SF_EXEC);
+	printf("%8s", "streams");
+	for(int m = NONE; m <= SFEXEC; m++)
+		printf(" %13s", names[m]);
+	printf("   (us per fork)\n");
+
+	FILE *f[SF_MAX];
+	for(int streams = 0; streams <= 512; streams = streams ? streams * 4 : 8) {
+		char name[64];
+		// Even streams write a file, odd ones read the one before.
+		for(int i = 0; i < streams; i += 2) {
+			snprintf(name, sizeof(name), "safefork-%d.txt", i);
+			f[i] = fopen(name, "w");
+			fprintf(f[i], "some text to read back\n");
+			fflush(f[i]);
+			f[i + 1] = fopen(name, "r");
+			fgetc(f[i + 1]);		// fill the read buffer
+		}
+		for(int i = 0; i < streams; i++)
+			sf_track(f[i]);
+		printf("%8d", streams);
+		for(int m = NONE; m <= SFEXEC; m++) {
+			double t = 0;
+			for(int k = 0; k < forks; k++) {
+				for(int i = 0; i < streams; i += 16)
+					fputc('x', f[i]);	// one in 8 writers dirty
+				double t0 = now();
+				pid_t pid;
+				if(m == ALL)
+					fflush(NULL);
+				else if(m == EACH)
+					for(int i = 0; i < streams; i++)
+						fflush(f[i]);
+				if(m == SF || m == SFEXEC) {
+					pid = sf_fork(m == SFEXEC ? SF_EXEC : 0);
+				} else {
+					sf_exec = 1;		// keep the hooks out of it
+					pid = fork();
+					sf_exec = 0;
+				}
+				if(pid == 0)
+					_exit(0);
+				t += now() - t0;
+				waitpid(pid, NULL, 0);
+				if(m == NONE || m == SFEXEC)
+					for(int i = 0; i < streams; i += 16)
+						__fpurge(f[i]);	// keep the files small
+			}
+			printf(" %13.1f", t / forks * 1e6);
+			fflush(stdout);
+		}
+		printf("\n");
+		for(int i = 0; i < streams; i++) {
+			sf_untrack(f[i]);
+			fclose(f[i]);
+			snprintf(name, sizeof(name), "safefork-%d.txt", i);
+			if(i % 2 == 0)
+				unlink(name);
+		}
+	}
+	unlink("safefork.txt");
+	return 0;
+}
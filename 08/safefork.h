@@ -0,0 +1,99 @@
+#ifndef __safefork_h__
+#define __safefork_h__
+
+// fork without duplicated stdio output, and without flushing everything.
+//
+// fork-fd2.c writes "hello world" twice when the FILE's buffer is not
+// flushed before fork: both processes inherit the bytes and both write
+// them. The usual cure is fflush(NULL) (or a fflush of every stream) before
+// each fork, which visits every open stream, and fflush on a stream being
+// read even lseeks and throws away its read buffer.
+//
+// Here streams are registered with sf_track, and fork hooks installed with
+// pthread_atfork take care of them, for sf_fork and for any other fork
+// (system, popen, a library's own):
+//
+//   before fork   flush only the tracked streams that have output pending
+//                 (__fpending > 0); streams being read are left alone
+//   in the child  with SF_EXEC, nothing is flushed before the fork at all;
+//                 instead the child drops (__fpurge) its copies of pending
+//                 output, since exec would lose them anyway, and a child
+//                 whose exec fails and calls exit() does not write them a
+//                 second time. The parent's buffers stay as they are.
+//
+// The list is under sf_lock, which the prepare hook takes and the parent
+// and child hooks release, so a fork in one thread never walks it while
+// another thread is changing it (or is about to fclose a stream on it).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdio_ext.h>
+
+#define SF_EXEC 1
+#define SF_MAX 1024
+
+FILE *sf_streams[SF_MAX];
+int sf_nstreams = 0;
+pthread_mutex_t sf_lock = PTHREAD_MUTEX_INITIALIZER;	// guards the two above
+__thread int sf_exec = 0;		// the fork in progress is an SF_EXEC one
+long sf_flushes = 0;
+
+void sf_prepare() {
+	pthread_mutex_lock(&sf_lock);	// held until sf_parent/sf_child
+	if(sf_exec)
+		return;
+	for(int i = 0; i < sf_nstreams; i++)
+		if(__fpending(sf_streams[i]) > 0) {
+			fflush(sf_streams[i]);
+			sf_flushes++;
+		}
+}
+
+void sf_parent() {
+	pthread_mutex_unlock(&sf_lock);
+}
+
+void sf_child() {
+	if(sf_exec)
+		for(int i = 0; i < sf_nstreams; i++)
+			if(__fpending(sf_streams[i]) > 0)
+				__fpurge(sf_streams[i]);
+	pthread_mutex_unlock(&sf_lock);
+}
+
+void sf_hook() {
+	assert(pthread_atfork(sf_prepare, sf_parent, sf_child) == 0);
+}
+
+void sf_track(FILE *f) {
+	static pthread_once_t hooked = PTHREAD_ONCE_INIT;
+	pthread_once(&hooked, sf_hook);
+	pthread_mutex_lock(&sf_lock);
+	assert(sf_nstreams < SF_MAX);
+	sf_streams[sf_nstreams++] = f;
+	pthread_mutex_unlock(&sf_lock);
+}
+
+// Call before fclose.
+void sf_untrack(FILE *f) {
+	pthread_mutex_lock(&sf_lock);
+	for(int i = 0; i < sf_nstreams; i++)
+		if(sf_streams[i] == f) {
+			sf_streams[i] = sf_streams[--sf_nstreams];
+			break;
+		}
+	pthread_mutex_unlock(&sf_lock);
+}
+
+// fork; with SF_EXEC the child is expected to exec (or _exit) right away.
+pid_t sf_fork(int flags) {
+	sf_exec = flags & SF_EXEC;
+	pid_t pid = fork();
+	sf_exec = 0;
+	return pid;
+}
+
+#endif // __safefork_h__
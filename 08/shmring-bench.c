@@ -0,0 +1,248 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include "shmring.h"
+
+// A child streams messages of 8 B to 1 MB to its parent through a pipe, a
+// Unix stream socket and a shmring.h ring; the parent reports MB/s. Then
+// the two play ping-pong with one message at a time, and the parent reports
+// the one-way latency (half the round trip). First it checks that a ring
+// behaves like a pipe when the other side is killed.
+//
+// usage: shmring-bench [ring KB]
+
+#define PIPE 0
+#define SOCK 1
+#define RING 2
+
+typedef struct _chan_t {
+	int kind;
+	int rfd, wfd;		// PIPE, SOCK
+	rg_t *rr, *wr;		// RING
+} chan_t;
+
+double now() {
+	struct timeval t;
+	gettimeofday(&t, NULL);
+	return t.tv_sec + t.tv_usec / 1e6;
+}
+
+void ch_write(chan_t *c, const char *p, long n) {
+	if(c->kind == RING) {
+		rg_write(c->wr, p, n);
+		return;
+	}
+	while(n > 0) {
+		ssize_t w = write(c->wfd, p, n);
+		if(w <= 0) {
+			printf("oops! write failed\n");
+			exit(-1);
+		}
+		p += w;
+		n -= w;
+	}
+}
+
+// Read exactly n bytes; 0 at end of stream.
+long ch_read(chan_t *c, char *p, long n) {
+	long got = 0;
+	while(got < n) {
+		long r = c->kind == RING ? rg_read(c->rr, p + got, n - got) : read(c->rfd, p + got, n - got);
+		if(r < 0) {
+			printf("oops! read failed\n");
+			exit(-1);
+		}
+		if(r == 0)
+			return 0;
+		got += r;
+	}
+	return got;
+}
+
+// Two one-way channels of the given kind: a for parent to child, b back.
+void ch_open(int kind, long ring, chan_t *a, chan_t *b) {
+	a->kind = b->kind = kind;
+	if(kind == PIPE) {
+		int p[2], q[2];
+		if(pipe(p) < 0 || pipe(q) < 0)
+			exit(-1);
+		a->rfd = p[0], a->wfd = p[1];
+		b->rfd = q[0], b->wfd = q[1];
+	} else if(kind == SOCK) {
+		int sv[2];
+		if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+			exit(-1);
+		a->wfd = b->rfd = sv[0];
+		a->rfd = b->wfd = sv[1];
+	} else {
+		a->rr = a->wr = malloc(sizeof(rg_t));
+		b->rr = b->wr = malloc(sizeof(rg_t));
+		if(rg_create(a->wr, ring) < 0 || rg_create(b->wr, ring) < 0) {
+			printf("oops! rg_create failed\n");
+			exit(-1);
+		}
+	}
+}
+
+void ch_close(chan_t *a, chan_t *b) {
+	if(a->kind == RING) {
+		rg_unmap(a->wr);
+		rg_unmap(b->wr);
+		free(a->wr);
+		free(b->wr);
+	} else if(a->kind == PIPE) {
+		close(a->rfd), close(a->wfd), close(b->rfd), close(b->wfd);
+	} else {
+		close(a->rfd), close(a->wfd);
+	}
+}
+
+// The child streams total bytes over b in messages of size bytes.
+double throughput(int kind, long ring, long size, long total) {
+	chan_t a, b;
+	ch_open(kind, ring, &a, &b);
+	char *buf = malloc(size);
+	memset(buf, 'x', size);
+	fflush(stdout);
+	double t = now();
+	pid_t pid = fork();
+	if(pid == 0) {
+		if(kind == RING)
+			rg_writer(b.wr);
+		for(long sent = 0; sent < total; sent += size)
+			ch_write(&b, buf, size);
+		if(kind == RING)
+			rg_close_write(b.wr);
+		exit(0);
+	}
+	long got = 0;
+	if(kind == RING)
+		rg_reader(b.rr);
+	else
+		close(b.wfd);		// so the parent sees end of file
+	while(ch_read(&b, buf, size) > 0)
+		got += size;
+	t = now() - t;
+	waitpid(pid, NULL, 0);
+	if(got != (total + size - 1) / size * size) {
+		printf("oops! got %ld bytes\n", got);
+		exit(-1);
+	}
+	ch_close(&a, &b);
+	free(buf);
+	return got / t / 1e6;
+}
+
+// One message to the child over a and back over b, reps times; returns
+// microseconds one way.
+double latency(int kind, long ring, long size, long reps) {
+	chan_t a, b;
+	ch_open(kind, ring, &a, &b);
+	char *buf = malloc(size);
+	memset(buf, 'x', size);
+	fflush(stdout);
+	pid_t pid = fork();
+	if(pid == 0) {
+		for(long i = 0; i < reps; i++) {
+			ch_read(&a, buf, size);
+			ch_write(&b, buf, size);
+		}
+		exit(0);
+	}
+	double t = now();
+	for(long i = 0; i < reps; i++) {
+		ch_write(&a, buf, size);
+		ch_read(&b, buf, size);
+	}
+	t = now() - t;
+	waitpid(pid, NULL, 0);
+	ch_close(&a, &b);
+	free(buf);
+	return t / reps / 2 * 1e6;
+}
+
+// A writer killed mid-stream gives its reader end of stream, and a killed
+// reader gives its writer EPIPE, instead of leaving them asleep.
+void check_dead_peer() {
+	rg_t r;
+	char buf[4096] = { 0 };
+	if(rg_create(&r, 4096) < 0) {
+		printf("oops! rg_create failed\n");
+		exit(-1);
+	}
+	pid_t pid = fork();
+	if(pid == 0) {
+		rg_writer(&r);
+		rg_write(&r, buf, 100);
+		kill(getpid(), SIGKILL);
+	}
+	rg_reader(&r);
+	long got = 0, n;
+	while((n = rg_read(&r, buf, sizeof(buf))) > 0)
+		got += n;
+	waitpid(pid, NULL, 0);
+	if(got != 100) {
+		printf("oops! read %ld bytes from a killed writer\n", got);
+		exit(-1);
+	}
+	rg_unmap(&r);
+
+	if(rg_create(&r, 4096) < 0) {
+		printf("oops! rg_create failed\n");
+		exit(-1);
+	}
+	pid = fork();
+	if(pid == 0) {
+		rg_reader(&r);
+		kill(getpid(), SIGKILL);
+	}
+	rg_writer(&r);
+	waitpid(pid, NULL, 0);		// a zombie, or gone: both count as dead
+	long w = 0;
+	while((n = rg_write(&r, buf, sizeof(buf))) > 0)
+		w += n;
+	if(n != -1 || errno != EPIPE || w != 4096) {
+		printf("oops! writing to a killed reader: %ld after %ld bytes\n", n, w);
+		exit(-1);
+	}
+	rg_unmap(&r);
+}
+
+int main(int argc, char *argv[]) {
+	long ring = (argc > 1 ? atol(argv[1]) : 1024) * 1024;
+	long sizes[] = { 8, 64, 512, 4096, 32768, 262144, 1048576 };
+	const char *names[] = { "pipe", "unix", "shmring" };
+
+	check_dead_peer();
+
+	printf("%8s %10s %10s %10s   (MB/s)\n", "msg", names[0], names[1], names[2]);
+	for(int i = 0; i < 7; i++) {
+		long total = sizes[i] < 256 ? sizes[i] << 20 : 256L << 20;
+		printf("%8ld", sizes[i]);
+		for(int k = PIPE; k <= RING; k++) {
+			printf(" %10.1f", throughput(k, ring, sizes[i], total));
+			fflush(stdout);
+		}
+		printf("\n");
+	}
+	printf("%8s %10s %10s %10s   (us one way)\n", "msg", names[0], names[1], names[2]);
+	for(int i = 0; i < 7; i++) {
+		long reps = (64L << 20) / sizes[i];
+		if(reps > 20000)
+			reps = 20000;
+		printf("%8ld", sizes[i]);
+		for(int k = PIPE; k <= RING; k++) {
+			printf(" %10.2f", latency(k, ring, sizes[i], reps));
+			fflush(stdout);
+		}
+		printf("\n");
+	}
+	return 0;
+}
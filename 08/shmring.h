@@ -0,0 +1,237 @@
+#ifndef __shmring_h__
+#define __shmring_h__
+
+// A byte stream between processes through shared memory, in place of the
+// pipe in pipe.c.
+//
+// A pipe copies every byte into the kernel on write and out again on read,
+// with a system call each time. Here the stream is a ring buffer in a memfd
+// that both processes map: the writer copies into it, the reader copies out,
+// and they coordinate through head and tail counters in the same memory.
+// The kernel is only entered to sleep and to wake: a reader finding the ring
+// empty (or a writer finding it full) sleeps on a futex, and the other side
+// only calls futex_wake when it sees that someone is asleep. Before going
+// to sleep a side yields the CPU a few times, which lets the other side get
+// on with it (especially on a single CPU) and often saves both futex calls.
+//
+// The interface follows pipe(2): rg_write blocks until everything is in the
+// ring, rg_read blocks until there is something and returns what there is
+// (0 at end of stream, once the writer has called rg_close_write). The ring
+// is inherited over fork, or can be opened from its memfd (rg_open), which
+// also survives exec. One reader and one writer.
+//
+// A side that dies without rg_close_write (a crash, a kill) cannot say so
+// itself. So each side claims its end with rg_reader/rg_writer, which puts
+// its pid in the ring, and a sleeping side wakes every RG_CHECK_MS to look
+// at the other one through a pidfd: a reader whose writer is gone gets end
+// of stream once the ring is empty, and a writer whose reader is gone gets
+// -1 with EPIPE, as with a pipe. Without the claims, a dead peer leaves the
+// other side asleep for good.
+//
+// memfd_create needs _GNU_SOURCE defined before the first #include.
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <assert.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define RG_HDR 4096		// the shared counters, one page
+#define RG_YIELDS 4		// sched_yield this often before sleeping
+#define RG_CHECK_MS 100		// how often a sleeper checks on its peer
+
+typedef struct _rg_shared_t {
+	// Written by the writer...
+	uint64_t tail __attribute__((aligned(64)));
+	uint32_t data_seq;		// bumped after every write; reader sleeps on it
+	uint32_t closed;
+	// ... and by the reader.
+	uint64_t head __attribute__((aligned(64)));
+	uint32_t space_seq;		// bumped after every read; writer sleeps on it
+	// Set by each side while it sleeps.
+	uint32_t rd_wait __attribute__((aligned(64)));
+	uint32_t wr_wait;
+	// Set by rg_reader/rg_writer.
+	pid_t rd_pid, wr_pid;
+} rg_shared_t;
+
+typedef struct _rg_t {
+	int fd;
+	rg_shared_t *s;
+	char *data;
+	size_t size;			// power of two
+} rg_t;
+
+int rg_map(rg_t *r, size_t size) {
+	char *p = mmap(NULL, RG_HDR + size, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, 0);
+	if(p == MAP_FAILED)
+		return -1;
+	r->s = (rg_shared_t*) p;
+	r->data = p + RG_HDR;
+	r->size = size;
+	return 0;
+}
+
+// A ring of size bytes (a power of two). Returns 0, or -1 with errno set.
+int rg_create(rg_t *r, size_t size) {
+	assert(size >= 4096 && (size & (size - 1)) == 0);
+	r->fd = memfd_create("shmring", 0);
+	if(r->fd < 0)
+		return -1;
+	if(ftruncate(r->fd, RG_HDR + size) != 0 || rg_map(r, size) != 0) {
+		int err = errno;
+		close(r->fd);
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+
+// Map the ring behind memfd fd, e.g. after exec.
+int rg_open(rg_t *r, int fd) {
+	struct stat st;
+	if(fstat(fd, &st) != 0)
+		return -1;
+	r->fd = fd;
+	return rg_map(r, st.st_size - RG_HDR);
+}
+
+void rg_unmap(rg_t *r) {
+	munmap(r->s, RG_HDR + r->size);
+	close(r->fd);
+}
+
+// Claim the reading or the writing end, so the other side can tell if we
+// die (see above).
+void rg_reader(rg_t *r) {
+	__atomic_store_n(&r->s->rd_pid, getpid(), __ATOMIC_RELEASE);
+}
+
+void rg_writer(rg_t *r) {
+	__atomic_store_n(&r->s->wr_pid, getpid(), __ATOMIC_RELEASE);
+}
+
+// Has process pid (0 if unknown) exited? A pidfd becomes readable once it
+// has, zombie or not.
+int rg_gone(pid_t *pid) {
+	pid_t p = __atomic_load_n(pid, __ATOMIC_ACQUIRE);
+	if(p == 0)
+		return 0;
+	int fd = syscall(SYS_pidfd_open, p, 0);
+	if(fd < 0)
+		return errno == ESRCH || (errno == ENOSYS && kill(p, 0) < 0 && errno == ESRCH);
+	struct pollfd pfd = { fd, POLLIN, 0 };
+	int gone = poll(&pfd, 1, 0) == 1;
+	close(fd);
+	return gone;
+}
+
+// Returns 0, or -1 if it timed out.
+int rg_futex_wait(uint32_t *w, uint32_t val) {
+	struct timespec t = { RG_CHECK_MS / 1000, RG_CHECK_MS % 1000 * 1000000 };
+	if(syscall(SYS_futex, w, FUTEX_WAIT, val, &t, NULL, 0) < 0 && errno == ETIMEDOUT)
+		return -1;
+	return 0;
+}
+
+void rg_futex_wake(uint32_t *w) {
+	syscall(SYS_futex, w, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+// Sleep on seq until ready holds, or until process *peer has gone (then
+// set dead). Announce the sleep in *waiting first and take seq before
+// checking again, so that a bump of seq after our check either changes the
+// value futex_wait expects or finds *waiting set and wakes us.
+#define rg_sleep_until(ready, waiting, seq, peer, dead)	do {			\
+	for(int y = 0; y < RG_YIELDS && !(ready); y++)				\
+		sched_yield();							\
+	while(!(ready)) {							\
+		__atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);			\
+		uint32_t v = __atomic_load_n(seq, __ATOMIC_SEQ_CST);		\
+		int timeout = !(ready) && rg_futex_wait(seq, v) < 0;		\
+		__atomic_store_n(waiting, 0, __ATOMIC_SEQ_CST);			\
+		if(timeout && rg_gone(peer) && !(ready)) {			\
+			dead = 1;						\
+			break;							\
+		}								\
+	}									\
+} while(0)
+
+void rg_notify(uint32_t *seq, uint32_t *waiting) {
+	__atomic_add_fetch(seq, 1, __ATOMIC_SEQ_CST);
+	if(__atomic_load_n(waiting, __ATOMIC_SEQ_CST))
+		rg_futex_wake(seq);
+}
+
+// Copy n bytes in, blocking while the ring is full. Returns n, or if the
+// reader has died, what was written before that or else -1 with EPIPE.
+long rg_write(rg_t *r, const void *buf, long n) {
+	rg_shared_t *s = r->s;
+	const char *p = buf;
+	uint64_t tail = s->tail;
+	long left = n;
+	while(left > 0) {
+		uint64_t head;
+		int dead = 0;
+		rg_sleep_until((head = __atomic_load_n(&s->head, __ATOMIC_ACQUIRE)) + r->size > tail,
+				&s->wr_wait, &s->space_seq, &s->rd_pid, dead);
+		if(dead) {
+			if(left < n)
+				return n - left;
+			errno = EPIPE;
+			return -1;
+		}
+		size_t k = head + r->size - tail, off = tail & (r->size - 1);
+		if(k > (size_t) left)
+			k = left;
+		size_t k1 = k < r->size - off ? k : r->size - off;
+		memcpy(r->data + off, p, k1);
+		memcpy(r->data, p + k1, k - k1);
+		tail += k;
+		p += k;
+		left -= k;
+		__atomic_store_n(&s->tail, tail, __ATOMIC_RELEASE);
+		rg_notify(&s->data_seq, &s->rd_wait);
+	}
+	return n;
+}
+
+// Copy up to n bytes out, blocking while the ring is empty. Returns the
+// number copied, 0 at end of stream (or once a dead writer's data is read).
+long rg_read(rg_t *r, void *buf, long n) {
+	rg_shared_t *s = r->s;
+	uint64_t head = s->head, tail;
+	uint32_t closed;
+	int dead = 0;
+	// closed before tail: once closed is seen, so is the last write.
+	rg_sleep_until((closed = __atomic_load_n(&s->closed, __ATOMIC_ACQUIRE),
+			(tail = __atomic_load_n(&s->tail, __ATOMIC_ACQUIRE)) != head || closed),
+			&s->rd_wait, &s->data_seq, &s->wr_pid, dead);
+	size_t k = tail - head, off = head & (r->size - 1);
+	if(dead || k == 0)		// the writer is gone, or closed the ring
+		return 0;
+	if(k > (size_t) n)
+		k = n;
+	size_t k1 = k < r->size - off ? k : r->size - off;
+	memcpy(buf, r->data + off, k1);
+	memcpy((char*) buf + k1, r->data, k - k1);
+	__atomic_store_n(&s->head, head + k, __ATOMIC_RELEASE);
+	rg_notify(&s->space_seq, &s->wr_wait);
+	return k;
+}
+
+// End of stream: the reader gets 0 once it has read everything.
+void rg_close_write(rg_t *r) {
+	__atomic_store_n(&r->s->closed, 1, __ATOMIC_RELEASE);
+	rg_notify(&r->s->data_seq, &r->s->rd_wait);
+}
+
+#endif // __shmring_h__
@@ -0,0 +1,67 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "spawn.h"
+
+// Time to start /bin/true and reap it, by method, as the parent's resident
+// memory grows from 1 MB to <max> MB (x4 each step). fork copies the page
+// tables of all of it; posix_spawn and vfork do not.
+//
+// usage: spawn-bench [max MB] [launches]
+
+double now() {
+	struct timeval t;
+	gettimeofday(&t, NULL);
+	return t.tv_sec + t.tv_usec / 1e6;
+}
+
+long rss_kb() {
+	FILE *f = fopen("/proc/self/statm", "r");
+	long size, rss;
+	assert(fscanf(f, "%ld %ld", &size, &rss) == 2);
+	fclose(f);
+	return rss * (getpagesize() / 1024);
+}
+
+int main(int argc, char *argv[]) {
+	long max = argc > 1 ? atol(argv[1]) : 4096;
+	int launches = argc > 2 ? atoi(argv[2]) : 50;
+	const char *names[] = { "fork", "posix_spawn", "vfork" };
+	char *args[] = { "/bin/true", NULL };
+
+	// Grow one mapping rather than allocating anew, so the RSS is what
+	// we asked for.
+	char *heap = NULL;
+	long have = 0;
+	printf("%8s %10s %12s %12s   (us per launch)\n", "RSS MB", names[0], names[1], names[2]);
+	for(long mb = 1; mb <= max; mb *= 4) {
+		heap = realloc(heap, mb << 20);
+		if(heap == NULL) {
+			printf("oops! cannot allocate %ld MB\n", mb);
+			exit(-1);
+		}
+		memset(heap + have, 1, (mb << 20) - have);
+		have = mb << 20;
+		printf("%8ld", rss_kb() / 1024);
+		for(int m = SPAWN_FORK; m <= SPAWN_VFORK; m++) {
+			double t = now();
+			for(int i = 0; i < launches; i++) {
+				int status;
+				pid_t pid = spawn(m, args[0], args, NULL);
+				if(pid < 0 || waitpid(pid, &status, 0) != pid || status != 0) {
+					printf("oops! %s launch failed\n", names[m]);
+					exit(-1);
+				}
+			}
+			printf(" %*.0f", m == SPAWN_FORK ? 10 : 12, (now() - t) / launches * 1e6);
+			fflush(stdout);
+		}
+		printf("\n");
+	}
+	return 0;
+}
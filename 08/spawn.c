@@ -0,0 +1,55 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <sys/wait.h>
+#include "spawn.h"
+
+// p4.c and pipe.c without fork: wc's output goes to p4.output, and echo's
+// comes back through a pipe.
+//
+// usage: spawn [fork|posix|vfork]
+
+int main(int argc, char *argv[]) {
+	int method = SPAWN_VFORK;
+	if(argc > 1)
+		method = argv[1][0] == 'f' ? SPAWN_FORK : argv[1][0] == 'p' ? SPAWN_POSIX : SPAWN_VFORK;
+
+	// p4.c: stdout to a file.
+	sp_actions_t a;
+	sp_init(&a);
+	sp_open(&a, STDOUT_FILENO, "./p4.output", O_CREAT|O_WRONLY|O_TRUNC, S_IRWXU);
+	char *wc[] = { "wc", "p4.c", NULL };
+	pid_t pid = spawn(method, wc[0], wc, &a);
+	assert(pid > 0);
+	int status;
+	assert(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+	// pipe.c: stdout into a pipe.
+	int p[2];
+	assert(pipe(p) == 0);
+	sp_init(&a);
+	sp_dup2(&a, p[1], STDOUT_FILENO);
+	sp_close(&a, p[0]);
+	sp_close(&a, p[1]);
+	char *echo[] = { "echo", "i was spawned, not forked", NULL };
+	pid = spawn(method, echo[0], echo, &a);
+	assert(pid > 0);
+	close(p[1]);
+	char buf[256];
+	ssize_t n;
+	while((n = read(p[0], buf, sizeof(buf))) > 0)
+		fwrite(buf, 1, n, stdout);
+	assert(waitpid(pid, &status, 0) == pid);
+
+	// A program that does not exist.
+	char *bad[] = { "no-such-program", NULL };
+	pid = spawn(method, bad[0], bad, NULL);
+	if(pid < 0)
+		perror("no-such-program");
+	else
+		printf("no-such-program: exit %d\n", waitpid(pid, &status, 0) == pid ? WEXITSTATUS(status) : -1);
+	return 0;
+}
@@ -0,0 +1,205 @@
+#ifndef __spawn_h__
+#define __spawn_h__
+
+// Starting a program without copying the parent.
+//
+// p3.c, p4.c and pipe.c fork and then exec right away. fork copies the
+// parent's page tables (and marks every page copy-on-write) only for exec to
+// throw them away, so a launch gets slower the bigger the parent is. Here a
+// launch is a program, its argv and a list of fd actions for the child, run
+// by one of three methods:
+//
+//   SPAWN_FORK    fork + execvp, as in p3.c, for comparison
+//   SPAWN_POSIX   posix_spawnp; glibc runs the actions in a vfork-like child
+//   SPAWN_VFORK   clone(CLONE_VM | CLONE_VFORK): the child borrows the
+//                 parent's memory on a small stack of its own, and the parent
+//                 sleeps until it has called exec (or failed to)
+//
+// The actions cover the redirections of the examples:
+//
+//   sp_open(&a, STDOUT_FILENO, "./p4.output", O_CREAT|O_WRONLY|O_TRUNC, S_IRWXU);
+//   sp_dup2(&a, p[1], STDOUT_FILENO); sp_close(&a, p[0]); sp_close(&a, p[1]);
+//
+// spawn returns the child's pid, or -1 with errno set if the program could
+// not be started (exec failures included, for every method but SPAWN_FORK,
+// which cannot tell). clone needs _GNU_SOURCE defined before the first
+// #include.
+
+#include <spawn.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define SPAWN_FORK 0
+#define SPAWN_POSIX 1
+#define SPAWN_VFORK 2
+
+#define SP_MAX 16
+#define SP_STACK (64 * 1024)
+
+extern char **environ;
+
+typedef struct _sp_action_t {
+	enum { SP_OPEN, SP_DUP2, SP_CLOSE } op;
+	int fd;
+	int from;			// SP_DUP2
+	const char *path;		// SP_OPEN
+	int flags;
+	mode_t mode;
+} sp_action_t;
+
+typedef struct _sp_actions_t {
+	int n;
+	sp_action_t a[SP_MAX];
+} sp_actions_t;
+
+void sp_init(sp_actions_t *a) {
+	a->n = 0;
+}
+
+sp_action_t *sp_add(sp_actions_t *a, int op, int fd) {
+	assert(a->n < SP_MAX);
+	sp_action_t *x = &a->a[a->n++];
+	x->op = op;
+	x->fd = fd;
+	return x;
+}
+
+// Open path as fd in the child.
+void sp_open(sp_actions_t *a, int fd, const char *path, int flags, mode_t mode) {
+	sp_action_t *x = sp_add(a, SP_OPEN, fd);
+	x->path = path;
+	x->flags = flags;
+	x->mode = mode;
+}
+
+void sp_dup2(sp_actions_t *a, int from, int fd) {
+	sp_add(a, SP_DUP2, fd)->from = from;
+}
+
+void sp_close(sp_actions_t *a, int fd) {
+	sp_add(a, SP_CLOSE, fd);
+}
+
+// Carry out the actions in the child. Only async-signal-safe calls here: in
+// the vfork child, nothing may touch the parent's locks or heap.
+int sp_apply(const sp_actions_t *a) {
+	for(int i = 0; a != NULL && i < a->n; i++) {
+		const sp_action_t *x = &a->a[i];
+		if(x->op == SP_OPEN) {
+			int fd = open(x->path, x->flags, x->mode);
+			if(fd < 0)
+				return -1;
+			if(fd != x->fd) {
+				if(dup2(fd, x->fd) < 0)
+					return -1;
+				close(fd);
+			}
+		} else if(x->op == SP_DUP2) {
+			if(dup2(x->from, x->fd) < 0)
+				return -1;
+		} else {
+			close(x->fd);
+		}
+	}
+	return 0;
+}
+
+pid_t spawn_fork(const char *file, char *const argv[], const sp_actions_t *a) {
+	pid_t pid = fork();
+	if(pid != 0)
+		return pid;
+	if(sp_apply(a) == 0)
+		execvp(file, argv);
+	_exit(127);
+}
+
+pid_t spawn_posix(const char *file, char *const argv[], const sp_actions_t *a) {
+	posix_spawn_file_actions_t fa;
+	posix_spawn_file_actions_init(&fa);
+	for(int i = 0; a != NULL && i < a->n; i++) {
+		const sp_action_t *x = &a->a[i];
+		if(x->op == SP_OPEN)
+			posix_spawn_file_actions_addopen(&fa, x->fd, x->path, x->flags, x->mode);
+		else if(x->op == SP_DUP2)
+			posix_spawn_file_actions_adddup2(&fa, x->from, x->fd);
+		else
+			posix_spawn_file_actions_addclose(&fa, x->fd);
+	}
+	pid_t pid;
+	int rc = posix_spawnp(&pid, file, &fa, NULL, argv, environ);
+	posix_spawn_file_actions_destroy(&fa);
+	if(rc != 0) {
+		errno = rc;
+		return -1;
+	}
+	return pid;
+}
+
+typedef struct _sp_child_t {
+	const char *file;
+	char *const *argv;
+	const sp_actions_t *a;
+	sigset_t mask;			// the parent's signal mask
+	int err;			// written by the child, read by the parent
+} sp_child_t;
+
+int sp_child(void *arg) {
+	sp_child_t *c = arg;
+	// Signals are blocked (see spawn_vfork); put the parent's handlers back
+	// to the default before unblocking them, as exec would.
+	struct sigaction dfl = { .sa_handler = SIG_DFL }, sa;
+	for(int s = 1; s < NSIG; s++)
+		if(sigaction(s, NULL, &sa) == 0 && sa.sa_handler != SIG_IGN && sa.sa_handler != SIG_DFL)
+			sigaction(s, &dfl, NULL);
+	sigprocmask(SIG_SETMASK, &c->mask, NULL);
+	if(sp_apply(c->a) == 0)
+		execvp(c->file, c->argv);
+	c->err = errno;			// shared memory: the parent sees this
+	_exit(127);
+}
+
+pid_t spawn_vfork(const char *file, char *const argv[], const sp_actions_t *a) {
+	// CLONE_VFORK only stops the calling thread, so every call gets its own
+	// stack; by the time clone returns, the child is done with it.
+	char *stack = mmap(NULL, SP_STACK, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+	if(stack == MAP_FAILED)
+		return -1;
+	sp_child_t c = { file, argv, a };
+	// Block signals so no handler of the parent runs on the child's stack.
+	sigset_t all;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &c.mask);
+	pid_t pid = clone(sp_child, stack + SP_STACK, CLONE_VM | CLONE_VFORK | SIGCHLD, &c);
+	int err = errno;
+	pthread_sigmask(SIG_SETMASK, &c.mask, NULL);
+	munmap(stack, SP_STACK);
+	if(pid < 0) {
+		errno = err;
+		return -1;
+	}
+	if(c.err != 0) {
+		waitpid(pid, NULL, 0);
+		errno = c.err;
+		return -1;
+	}
+	return pid;
+}
+
+pid_t spawn(int method, const char *file, char *const argv[], const sp_actions_t *a) {
+	if(method == SPAWN_POSIX)
+		return spawn_posix(file, argv, a);
+	if(method == SPAWN_VFORK)
+		return spawn_vfork(file, argv, a);
+	return spawn_fork(file, argv, a);
+}
+
+#endif // __spawn_h__
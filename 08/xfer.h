@@ -0,0 +1,146 @@
+#ifndef __xfer_h__
+#define __xfer_h__
+
+// Moving data through pipes without a system call per byte.
+//
+// pipe.c reads its input one byte at a time. When the data only has to be
+// passed on unchanged, xfer_splice moves it from one fd to the other inside
+// the kernel with splice (at least one side must be a pipe; if neither is,
+// it goes through a private pipe), xfer_tee also copies it to a second pipe
+// with tee, and xfer_vmsplice puts user memory into a pipe without copying
+// it. When the data has to be transformed, xfer_upper reads big blocks,
+// uppercases a whole block at once with xform.h's SIMD kernel and writes it
+// with one call.
+//
+// Where splice is not supported (some fd types refuse it), the functions
+// fall back to read/write. splice and friends need _GNU_SOURCE defined
+// before the first #include.
+
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include "xform.h"
+
+#define XFER_BLOCK (64 * 1024)	// default pipe capacity
+
+// Write all n bytes.
+int write_all(int fd, const char *p, long n) {
+	while(n > 0) {
+		ssize_t w = write(fd, p, n);
+		if(w < 0 && errno == EINTR)
+			continue;
+		if(w <= 0)
+			return -1;
+		p += w;
+		n -= w;
+	}
+	return 0;
+}
+
+// Copy in to out until EOF with read/write. Returns bytes moved, or -1.
+long xfer_copy(int in, int out) {
+	static char buf[XFER_BLOCK];
+	long total = 0;
+	ssize_t n;
+	while((n = read(in, buf, sizeof(buf))) > 0) {
+		if(write_all(out, buf, n) < 0)
+			return -1;
+		total += n;
+	}
+	return n < 0 ? -1 : total;
+}
+
+int is_pipe(int fd) {
+	struct stat st;
+	return fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+// Move everything from in to out until EOF. Returns bytes moved, or -1.
+long xfer_splice(int in, int out) {
+	if(!is_pipe(in) && !is_pipe(out)) {
+		// splice needs a pipe on one side; put one in the middle.
+		int p[2];
+		if(pipe(p) < 0)
+			return -1;
+		long total = 0;
+		ssize_t n;
+		while((n = splice(in, NULL, p[1], NULL, XFER_BLOCK, SPLICE_F_MOVE)) > 0) {
+			total += n;
+			while(n > 0) {
+				ssize_t m = splice(p[0], NULL, out, NULL, n, SPLICE_F_MOVE);
+				if(m <= 0) {
+					close(p[0]);
+					close(p[1]);
+					return -1;
+				}
+				n -= m;
+			}
+		}
+		close(p[0]);
+		close(p[1]);
+		if(n < 0 && errno == EINVAL && total == 0)
+			return xfer_copy(in, out);
+		return n < 0 ? -1 : total;
+	}
+	long total = 0;
+	ssize_t n;
+	while((n = splice(in, NULL, out, NULL, XFER_BLOCK, SPLICE_F_MOVE | SPLICE_F_MORE)) > 0)
+		total += n;
+	if(n < 0 && errno == EINVAL && total == 0)
+		return xfer_copy(in, out);
+	return n < 0 ? -1 : total;
+}
+
+// Like xfer_splice from pipe in to out, also copying everything to pipe
+// copy. tee duplicates pipe buffers by reference, so nothing is copied.
+long xfer_tee(int in, int out, int copy) {
+	long total = 0;
+	ssize_t n;
+	while((n = tee(in, copy, XFER_BLOCK, 0)) > 0) {
+		total += n;
+		while(n > 0) {
+			ssize_t m = splice(in, NULL, out, NULL, n, SPLICE_F_MOVE);
+			if(m <= 0)
+				return -1;
+			n -= m;
+		}
+	}
+	return n < 0 ? -1 : total;
+}
+
+// Put n bytes of user memory into pipe out. The pages are referenced, not
+// copied, so buf must not change until the reader has consumed them.
+int xfer_vmsplice(int out, const char *buf, long n) {
+	while(n > 0) {
+		struct iovec iov = { (void*) buf, n };
+		ssize_t w = vmsplice(out, &iov, 1, 0);
+		if(w < 0 && errno == EINTR)
+			continue;
+		if(w < 0 && errno == EINVAL)	// out is not a pipe
+			return write_all(out, buf, n);
+		if(w <= 0)
+			return -1;
+		buf += w;
+		n -= w;
+	}
+	return 0;
+}
+
+// Uppercase everything from in into out, a block at a time.
+long xfer_upper(int in, int out) {
+	static char buf[XFER_BLOCK];
+	long total = 0;
+	ssize_t n;
+	while((n = read(in, buf, sizeof(buf))) > 0) {
+		xform_upper(buf, n);
+		if(write_all(out, buf, n) < 0)
+			return -1;
+		total += n;
+	}
+	return n < 0 ? -1 : total;
+}
+
+#endif // __xfer_h__
@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "xform.h"
+
+// Throughput of every xform.h kernel the CPU supports, on text buffers of
+// 64 B up to <max> bytes (x4 each step), for upper, lower and map (with
+// xform_table_class). Each measurement transforms about TOTAL bytes in
+// all. Every kernel is first checked against the scalar one on all lengths
+// up to 300.
+//
+// usage: xform-bench [max]
+
+#define TOTAL (512L << 20)
+
+double now() {
+	struct timeval t;
+	gettimeofday(&t, NULL);
+	return t.tv_sec + t.tv_usec / 1e6;
+}
+
+unsigned char table[256];
+
+void run(xform_impl_t *x, int op, char *p, long n) {
+	if(op == 0)
+		x->range(p, n, 'a', 'z', 'A' - 'a');
+	else if(op == 1)
+		x->range(p, n, 'A', 'Z', 'a' - 'A');
+	else
+		x->map(p, n, table);
+}
+
+int main(int argc, char *argv[]) {
+	long max = argc > 1 ? atol(argv[1]) : 64L << 20;
+	const char *ops[] = { "upper", "lower", "map" };
+	xform_table_class(table);
+
+	char a[300], b[300];
+	for(int i = 0; i < XFORM_IMPLS; i++) {
+		if(!xform_impls[i].supported())
+			continue;
+		for(int op = 0; op < 3; op++)
+			for(int n = 0; n <= 300; n++) {
+				for(int j = 0; j < 300; j++)
+					a[j] = b[j] = rand();
+				run(&xform_impls[0], op, a, n);
+				run(&xform_impls[i], op, b, n);
+				if(memcmp(a, b, 300) != 0) {
+					printf("oops! %s %s differs from scalar at n=%d\n",
+							xform_impls[i].name, ops[op], n);
+					exit(-1);
+				}
+			}
+	}
+
+	char *buf = malloc(max);
+	for(long j = 0; j < max; j++)
+		buf[j] = j % 64 == 63 ? '\n' : j % 8 == 7 ? ' ' : (j % 3 ? 'a' : 'A') + j % 26;
+	printf("dispatch picks %s\n", xform_best()->name);
+	printf("%-6s %10s", "op", "bytes");
+	for(int i = 0; i < XFORM_IMPLS; i++)
+		if(xform_impls[i].supported())
+			printf(" %9s", xform_impls[i].name);
+	printf("   (GB/s)\n");
+	for(int op = 0; op < 3; op++) {
+		for(long n = 64; n <= max; n *= 4) {
+			printf("%-6s %10ld", ops[op], n);
+			long reps = TOTAL / n;
+			for(int i = 0; i < XFORM_IMPLS; i++) {
+				if(!xform_impls[i].supported())
+					continue;
+				double t = now();
+				for(long r = 0; r < reps; r++)
+					run(&xform_impls[i], op, buf, n);
+				t = now() - t;
+				printf(" %9.2f", reps * n / t / 1e9);
+			}
+			printf("\n");
+			fflush(stdout);
+		}
+	}
+	return 0;
+}
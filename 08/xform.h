@@ -0,0 +1,196 @@
+#ifndef __xform_h__
+#define __xform_h__
+
+// In-place byte transforms for text filters like pipe.c's uppercasing.
+//
+//   xform_upper / xform_lower   ASCII case conversion
+//   xform_range                 add delta to every byte in [lo, hi], the
+//                               kernel behind the two above
+//   xform_map                   replace every byte c with table[c], for
+//                               byte-class mapping (e.g. xform_table_class)
+//
+// Each comes in scalar, SSE2, AVX2 and AVX-512 versions, working on 16, 32
+// or 64 bytes per instruction. The xform_* entry points pick the widest one
+// the CPU supports on first use. Only AVX-512 with VBMI has a table lookup
+// wide enough to pay: vpermi2b looks up 128 entries at once. Below that
+// xform_map is the scalar loop (SSE2 has no byte shuffle, and a 256-entry
+// table split over 16 pshufb lookups measured no faster than scalar), so a
+// CPU with AVX512BW but no VBMI (Skylake-X, Cascade Lake) gets the AVX-512
+// xform_range and the scalar xform_map.
+
+#include <stdint.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD
+#endif
+
+typedef void (*range_fn_t)(char *p, long n, unsigned char lo, unsigned char hi, char delta);
+typedef void (*map_fn_t)(char *p, long n, const unsigned char *table);
+
+typedef struct _xform_impl_t {
+	const char *name;
+	int (*supported)();
+	range_fn_t range;
+	map_fn_t map;
+} xform_impl_t;
+
+int have_any() {
+	return 1;
+}
+
+void range_scalar(char *p, long n, unsigned char lo, unsigned char hi, char delta) {
+	for(long i = 0; i < n; i++)
+		if((unsigned char) (p[i] - lo) <= (unsigned char) (hi - lo))
+			p[i] += delta;
+}
+
+void map_scalar(char *p, long n, const unsigned char *table) {
+	for(long i = 0; i < n; i++)
+		p[i] = table[(unsigned char) p[i]];
+}
+
+#ifdef HAVE_X86_SIMD
+// A byte c is in [lo, hi] iff c - lo <= hi - lo as unsigned bytes, i.e. iff
+// min(c - lo, hi - lo) == c - lo.
+__attribute__((target("sse2")))
+void range_sse2(char *p, long n, unsigned char lo, unsigned char hi, char delta) {
+	const __m128i vlo = _mm_set1_epi8(lo), span = _mm_set1_epi8(hi - lo);
+	const __m128i d = _mm_set1_epi8(delta);
+	long i = 0;
+	for(; i + 16 <= n; i += 16) {
+		__m128i x = _mm_loadu_si128((__m128i*) (p + i));
+		__m128i t = _mm_sub_epi8(x, vlo);
+		__m128i m = _mm_cmpeq_epi8(_mm_min_epu8(t, span), t);
+		_mm_storeu_si128((__m128i*) (p + i), _mm_add_epi8(x, _mm_and_si128(m, d)));
+	}
+	range_scalar(p + i, n - i, lo, hi, delta);
+}
+
+__attribute__((target("avx2")))
+void range_avx2(char *p, long n, unsigned char lo, unsigned char hi, char delta) {
+	const __m256i vlo = _mm256_set1_epi8(lo), span = _mm256_set1_epi8(hi - lo);
+	const __m256i d = _mm256_set1_epi8(delta);
+	long i = 0;
+	for(; i + 32 <= n; i += 32) {
+		__m256i x = _mm256_loadu_si256((__m256i*) (p + i));
+		__m256i t = _mm256_sub_epi8(x, vlo);
+		__m256i m = _mm256_cmpeq_epi8(_mm256_min_epu8(t, span), t);
+		_mm256_storeu_si256((__m256i*) (p + i), _mm256_add_epi8(x, _mm256_and_si256(m, d)));
+	}
+	// The tail runs legacy SSE code, which stalls while the upper halves
+	// of the ymm registers are dirty.
+	_mm256_zeroupper();
+	range_sse2(p + i, n - i, lo, hi, delta);
+}
+
+__attribute__((target("avx512bw")))
+void range_avx512(char *p, long n, unsigned char lo, unsigned char hi, char delta) {
+	const __m512i vlo = _mm512_set1_epi8(lo), span = _mm512_set1_epi8(hi - lo);
+	const __m512i d = _mm512_set1_epi8(delta);
+	long i = 0;
+	for(; i + 64 <= n; i += 64) {
+		__m512i x = _mm512_loadu_si512(p + i);
+		__mmask64 m = _mm512_cmple_epu8_mask(_mm512_sub_epi8(x, vlo), span);
+		_mm512_storeu_si512(p + i, _mm512_mask_add_epi8(x, m, x, d));
+	}
+	if(i < n) {
+		// Masked load and store for the tail, no scalar loop.
+		__mmask64 k = _cvtu64_mask64(~0ULL >> (64 - (n - i)));
+		__m512i x = _mm512_maskz_loadu_epi8(k, p + i);
+		__mmask64 m = _mm512_cmple_epu8_mask(_mm512_sub_epi8(x, vlo), span);
+		_mm512_mask_storeu_epi8(p + i, k, _mm512_mask_add_epi8(x, m, x, d));
+	}
+}
+
+// vpermi2b picks from 128 table bytes by the low 7 bits of each byte; do
+// both halves of the table and choose by the top bit.
+__attribute__((target("avx512bw,avx512vbmi")))
+void map_avx512(char *p, long n, const unsigned char *table) {
+	const __m512i t0 = _mm512_loadu_si512(table), t1 = _mm512_loadu_si512(table + 64);
+	const __m512i t2 = _mm512_loadu_si512(table + 128), t3 = _mm512_loadu_si512(table + 192);
+	long i = 0;
+	for(; i + 64 <= n; i += 64) {
+		__m512i x = _mm512_loadu_si512(p + i);
+		__m512i a = _mm512_permutex2var_epi8(t0, x, t1);
+		__m512i b = _mm512_permutex2var_epi8(t2, x, t3);
+		_mm512_storeu_si512(p + i, _mm512_mask_blend_epi8(_mm512_movepi8_mask(x), a, b));
+	}
+	_mm256_zeroupper();
+	map_scalar(p + i, n - i, table);
+}
+
+int have_sse2() {
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+}
+
+int have_avx2() {
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+int have_avx512bw() {
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx512bw");
+}
+
+int have_avx512vbmi() {
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vbmi");
+}
+#endif // HAVE_X86_SIMD
+
+// Narrowest first.
+xform_impl_t xform_impls[] = {
+	{ "scalar", have_any, range_scalar, map_scalar },
+#ifdef HAVE_X86_SIMD
+	{ "sse2", have_sse2, range_sse2, map_scalar },
+	{ "avx2", have_avx2, range_avx2, map_scalar },
+	{ "avx512bw", have_avx512bw, range_avx512, map_scalar },
+	{ "avx512", have_avx512vbmi, range_avx512, map_avx512 },
+#endif
+};
+
+#define XFORM_IMPLS ((int) (sizeof(xform_impls) / sizeof(xform_impls[0])))
+
+xform_impl_t *xform_best() {
+	static xform_impl_t *best = NULL;
+	for(int i = XFORM_IMPLS - 1; best == NULL; i--)
+		if(xform_impls[i].supported())
+			best = &xform_impls[i];
+	return best;
+}
+
+void xform_range(char *p, long n, unsigned char lo, unsigned char hi, char delta) {
+	xform_best()->range(p, n, lo, hi, delta);
+}
+
+void xform_upper(char *p, long n) {
+	xform_range(p, n, 'a', 'z', 'A' - 'a');
+}
+
+void xform_lower(char *p, long n) {
+	xform_range(p, n, 'A', 'Z', 'a' - 'A');
+}
+
+void xform_map(char *p, long n, const unsigned char *table) {
+	xform_best()->map(p, n, table);
+}
+
+// A table mapping letters to 'a', digits to '0', white space to ' ' and
+// everything else to '.', e.g. to normalize log lines before matching.
+void xform_table_class(unsigned char *table) {
+	for(int c = 0; c < 256; c++) {
+		if((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+			table[c] = 'a';
+		else if(c >= '0' && c <= '9')
+			table[c] = '0';
+		else if(c == ' ' || c == '\t' || c == '\n' || c == '\r')
+			table[c] = ' ';
+		else
+			table[c] = '.';
+	}
+}
+
+#endif // __xform_h__
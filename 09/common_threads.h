@@ -7,6 +7,17 @@
 
 #ifdef __linux__
 #include <semaphore.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#define CACHELINE 64
+
+#if defined(__i386__) || defined(__x86_64__)
+#define cpu_relax()                                      asm volatile("pause":::"memory")
+#else
+#define cpu_relax()                                      asm volatile("":::"memory")
 #endif
 
 #define Pthread_create(thread, attr, start_routine, arg) assert(pthread_create(thread, attr, start_routine, arg) == 0);
@@ -28,6 +39,10 @@
 #define Sem_init(sem, value)                             assert(sem_init(sem, 0, value) == 0);
 #define Sem_wait(sem)                                    assert(sem_wait(sem) == 0);
 #define Sem_post(sem)                                    assert(sem_post(sem) == 0);
+
+// Sleep only if *addr still holds val; wake up to n sleepers on addr.
+#define Futex_wait(addr, val)                            syscall(SYS_futex, (addr), FUTEX_WAIT_PRIVATE, (val), NULL, NULL, 0)
+#define Futex_wake(addr, n)                              syscall(SYS_futex, (addr), FUTEX_WAKE_PRIVATE, (n), NULL, NULL, 0)
 #endif // __linux__
 
 #endif // __common_threads_h__
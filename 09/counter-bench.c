@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include "common.h"
+#include "common_threads.h"
+#include "counter.h"
+
+// Runs the counter++ loop of threads-safe.c (mutex), semlock.c (semaphore),
+// atomic.c (one atomic_int) and counter.h (sharded slots) on 1, 2, 4, ...
+// <max> threads and reports ns per increment (wall time / total increments).
+//
+// usage: counter-bench [max threads] [loops per thread]
+
+volatile long long counter = 0;
+atomic_llong acounter = 0;
+pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+sem_t s;
+counter_t sc;
+
+int loops;
+int mode;
+const char *names[] = { "mutex", "semaphore", "atomic", "sharded" };
+
+void *worker(void *arg) {
+	int i;
+	switch(mode) {
+	case 0:
+		for (i = 0; i < loops; i++) {
+			pthread_mutex_lock(&lock);
+			counter++;
+			pthread_mutex_unlock(&lock);
+		}
+		break;
+	case 1:
+		for (i = 0; i < loops; i++) {
+			sem_wait(&s);
+			counter++;
+			sem_post(&s);
+		}
+		break;
+	case 2:
+		for (i = 0; i < loops; i++)
+			acounter++;
+		break;
+	case 3: {
+		counter_slot_t *slot = counter_register(&sc);
+		for (i = 0; i < loops; i++)
+			counter_inc(&sc, slot);
+		counter_flush(&sc, slot);
+		break;
+	}
+	}
+	return NULL;
+}
+
+double run(int md, int nthreads) {
+	pthread_t p[nthreads];
+	mode = md;
+	counter = 0;
+	acounter = 0;
+	sem_init(&s, 0, 1);
+	counter_init(&sc, 1024);
+
+	double t = GetTime();
+	for(int i = 0; i < nthreads; i++)
+		Pthread_create(&p[i], NULL, worker, NULL);
+	for(int i = 0; i < nthreads; i++)
+		Pthread_join(p[i], NULL);
+	t = GetTime() - t;
+
+	long long total = (long long) loops * nthreads;
+	long long got = md == 2 ? acounter : md == 3 ? counter_read_exact(&sc) : counter;
+	if(got != total || (md == 3 && counter_read(&sc) != total)) {
+		printf("oops! %s counted %lld, expected %lld\n", names[md], got, total);
+		exit(-1);
+	}
+	sem_destroy(&s);
+	return t * 1e9 / total;
+}
+
+int main(int argc, char *argv[]) {
+	int max = argc > 1 ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+	loops = argc > 2 ? atoi(argv[2]) : 1000000;
+	printf("threads");
+	for(int m = 0; m < 4; m++)
+		printf(" %12s", names[m]);
+	printf("   (ns/op)\n");
+	for(int n = 1; n <= max; n = n < max && n * 2 > max ? max : n * 2) {
+		printf("%7d", n);
+		for(int m = 0; m < 4; m++)
+			printf(" %12.2f", run(m, n));
+		printf("\n");
+	}
+	return 0;
+}
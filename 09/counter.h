@@ -0,0 +1,77 @@
+#ifndef __counter_h__
+#define __counter_h__
+
+// Sharded statistical counter.
+//
+// Each thread registers once and gets its own cache-line-sized slot. An
+// increment is a relaxed load and store of that slot: no lock, no atomic
+// read-modify-write and no cache line shared with other writers. Every
+// <threshold> increments a thread also pushes its delta into a global total
+// (the "sloppy counter" of OSTEP chapter 29), so:
+//   counter_read()        O(1), lags the truth by < threshold per thread
+//   counter_read_exact()  sums every slot; counts every completed increment
+
+#include <stdatomic.h>
+#include "common_threads.h"
+
+#define COUNTER_MAX_THREADS 256
+
+typedef struct _counter_slot_t {
+	_Alignas(CACHELINE) atomic_llong v;	// written only by the owner
+	long long flushed;			// part of v already in global
+} counter_slot_t;
+
+typedef struct _counter_t {
+	_Alignas(CACHELINE) atomic_llong global;
+	long long threshold;
+	atomic_int nslots;
+	counter_slot_t slot[COUNTER_MAX_THREADS];
+} counter_t;
+
+void counter_init(counter_t *c, long long threshold) {
+	atomic_init(&c->global, 0);
+	atomic_init(&c->nslots, 0);
+	c->threshold = threshold;
+	for(int i = 0; i < COUNTER_MAX_THREADS; i++) {
+		atomic_init(&c->slot[i].v, 0);
+		c->slot[i].flushed = 0;
+	}
+}
+
+// Call once per thread; the slot is the thread's handle to the counter.
+counter_slot_t *counter_register(counter_t *c) {
+	int i = atomic_fetch_add(&c->nslots, 1);
+	assert(i < COUNTER_MAX_THREADS);
+	return &c->slot[i];
+}
+
+void counter_flush(counter_t *c, counter_slot_t *s) {
+	long long v = atomic_load_explicit(&s->v, memory_order_relaxed);
+	atomic_fetch_add_explicit(&c->global, v - s->flushed, memory_order_relaxed);
+	s->flushed = v;
+}
+
+void counter_add(counter_t *c, counter_slot_t *s, long long n) {
+	long long v = atomic_load_explicit(&s->v, memory_order_relaxed) + n;
+	atomic_store_explicit(&s->v, v, memory_order_relaxed);
+	if(v - s->flushed >= c->threshold)
+		counter_flush(c, s);
+}
+
+void counter_inc(counter_t *c, counter_slot_t *s) {
+	counter_add(c, s, 1);
+}
+
+long long counter_read(counter_t *c) {
+	return atomic_load_explicit(&c->global, memory_order_relaxed);
+}
+
+long long counter_read_exact(counter_t *c) {
+	long long sum = 0;
+	int n = atomic_load(&c->nslots);
+	for(int i = 0; i < n && i < COUNTER_MAX_THREADS; i++)
+		sum += atomic_load_explicit(&c->slot[i].v, memory_order_relaxed);
+	return sum;
+}
+
+#endif // __counter_h__
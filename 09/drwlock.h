@@ -0,0 +1,111 @@
+#ifndef __drwlock_h__
+#define __drwlock_h__
+
+// Distributed reader-writer lock.
+//
+// Every reader thread registers once and gets its own cache-line-sized
+// indicator. A read acquire sets the indicator and checks that no writer is
+// around, so an uncontended reader writes only its own line and reads the
+// writer word, which stays shared in every cache until a writer shows up.
+// A writer raises the writer word and then waits for every indicator to
+// drop, so writes pay O(readers) instead of reads paying a shared counter.
+//
+// With DRW_PREFER_WRITER, new readers back off as soon as a writer raises
+// its flag, so a steady stream of readers cannot starve writers. With
+// DRW_PREFER_READER the writer lowers the flag again whenever it finds a
+// reader inside and only gets in during a gap between readers.
+
+#include <limits.h>
+#include <stdatomic.h>
+#include "common_threads.h"
+
+#define DRW_MAX_READERS 256
+#define DRW_SPINS 1024
+
+enum { DRW_PREFER_WRITER, DRW_PREFER_READER };
+
+typedef struct _drw_slot_t {
+	_Alignas(CACHELINE) atomic_int active;
+} drw_slot_t;
+
+typedef struct _drwlock_t {
+	_Alignas(CACHELINE) atomic_int writer;	// futex: 1 while a writer is in or draining
+	int mode;
+	atomic_int nslots;
+	pthread_mutex_t wlock;			// one writer at a time
+	drw_slot_t slot[DRW_MAX_READERS];
+} drwlock_t;
+
+void drw_init(drwlock_t *l, int mode) {
+	atomic_init(&l->writer, 0);
+	atomic_init(&l->nslots, 0);
+	l->mode = mode;
+	pthread_mutex_init(&l->wlock, NULL);
+	for(int i = 0; i < DRW_MAX_READERS; i++)
+		atomic_init(&l->slot[i].active, 0);
+}
+
+// Call once per reader thread.
+drw_slot_t *drw_register(drwlock_t *l) {
+	int i = atomic_fetch_add(&l->nslots, 1);
+	assert(i < DRW_MAX_READERS);
+	return &l->slot[i];
+}
+
+void drw_read_lock(drwlock_t *l, drw_slot_t *s) {
+	while(1) {
+		// seq_cst store then load: pairs with the writer raising its flag
+		// and then reading our indicator, so one of us always sees the other.
+		atomic_store(&s->active, 1);
+		if(atomic_load(&l->writer) == 0)
+			return;
+		atomic_store(&s->active, 0);
+		int i = 0;
+		while(atomic_load(&l->writer) != 0) {
+			if(++i < DRW_SPINS)
+				cpu_relax();
+			else
+				Futex_wait(&l->writer, 1);
+		}
+	}
+}
+
+void drw_read_unlock(drwlock_t *l, drw_slot_t *s) {
+	atomic_store_explicit(&s->active, 0, memory_order_release);
+}
+
+// Returns the index of a reader still inside, or -1 if there is none.
+int drw_busy_reader(drwlock_t *l) {
+	int n = atomic_load(&l->nslots);
+	for(int i = 0; i < n; i++)
+		if(atomic_load(&l->slot[i].active))
+			return i;
+	return -1;
+}
+
+void drw_write_lock(drwlock_t *l) {
+	pthread_mutex_lock(&l->wlock);
+	while(1) {
+		atomic_store(&l->writer, 1);
+		if(l->mode == DRW_PREFER_WRITER) {
+			// Readers are backing off; wait for the ones inside to leave.
+			while(drw_busy_reader(l) >= 0)
+				sched_yield();
+			return;
+		}
+		if(drw_busy_reader(l) < 0)
+			return;
+		// Let the readers carry on and try again later.
+		atomic_store(&l->writer, 0);
+		Futex_wake(&l->writer, INT_MAX);
+		sched_yield();
+	}
+}
+
+void drw_write_unlock(drwlock_t *l) {
+	atomic_store(&l->writer, 0);
+	Futex_wake(&l->writer, INT_MAX);
+	pthread_mutex_unlock(&l->wlock);
+}
+
+#endif // __drwlock_h__
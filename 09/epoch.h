@@ -0,0 +1,100 @@
+#ifndef __epoch_h__
+#define __epoch_h__
+
+// Epoch-based reclamation for RCU-style readers.
+//
+// Readers bracket their use of shared pointers with epoch_enter/epoch_exit;
+// these only write the reader's own cache line. A writer publishes a new
+// version with an atomic store and hands the old one to epoch_retire instead
+// of freeing it. epoch_retire advances the global epoch and frees everything
+// retired before the oldest epoch some reader is still in, so the writer
+// never waits for readers: memory just lingers until they move on.
+// Writers must be serialized by the caller.
+
+#include <stdlib.h>
+#include <stdatomic.h>
+#include "common_threads.h"
+
+#define EPOCH_MAX_READERS 256
+#define EPOCH_IDLE 0
+
+typedef struct _epoch_slot_t {
+	_Alignas(CACHELINE) atomic_uint epoch;	// EPOCH_IDLE or the epoch we entered in
+} epoch_slot_t;
+
+typedef struct _retired_t {
+	void *p;
+	unsigned epoch;
+	struct _retired_t *next;
+} retired_t;
+
+typedef struct _epoch_t {
+	_Alignas(CACHELINE) atomic_uint global;
+	atomic_int nslots;
+	retired_t *limbo;			// writer only
+	epoch_slot_t slot[EPOCH_MAX_READERS];
+} epoch_t;
+
+void epoch_init(epoch_t *e) {
+	atomic_init(&e->global, 1);
+	atomic_init(&e->nslots, 0);
+	e->limbo = NULL;
+	for(int i = 0; i < EPOCH_MAX_READERS; i++)
+		atomic_init(&e->slot[i].epoch, EPOCH_IDLE);
+}
+
+// Call once per reader thread.
+epoch_slot_t *epoch_register(epoch_t *e) {
+	int i = atomic_fetch_add(&e->nslots, 1);
+	assert(i < EPOCH_MAX_READERS);
+	return &e->slot[i];
+}
+
+void epoch_enter(epoch_t *e, epoch_slot_t *s) {
+	// seq_cst store before the caller's seq_cst pointer load: pairs with
+	// the writer publishing and then scanning the slots in epoch_retire.
+	atomic_store(&s->epoch, atomic_load(&e->global));
+}
+
+void epoch_exit(epoch_t *e, epoch_slot_t *s) {
+	atomic_store_explicit(&s->epoch, EPOCH_IDLE, memory_order_release);
+}
+
+// Free what no reader can still see. Returns the number of blocks freed.
+int epoch_reclaim(epoch_t *e) {
+	unsigned min = atomic_load(&e->global);
+	int n = atomic_load(&e->nslots);
+	for(int i = 0; i < n; i++) {
+		unsigned v = atomic_load(&e->slot[i].epoch);
+		if(v != EPOCH_IDLE && v < min)
+			min = v;
+	}
+	int freed = 0;
+	retired_t **pp = &e->limbo;
+	while(*pp != NULL) {
+		retired_t *r = *pp;
+		if(r->epoch <= min) {
+			*pp = r->next;
+			free(r->p);
+			free(r);
+			freed++;
+		} else {
+			pp = &r->next;
+		}
+	}
+	return freed;
+}
+
+// p was unpublished (replaced with a seq_cst store) before this call.
+void epoch_retire(epoch_t *e, void *p) {
+	retired_t *r = malloc(sizeof(retired_t));
+	assert(r != NULL);
+	r->p = p;
+	// Readers that entered before this bump may still hold p.
+	r->epoch = atomic_fetch_add(&e->global, 1) + 1;
+	r->next = e->limbo;
+	e->limbo = r;
+	epoch_reclaim(e);
+}
+
+#endif // __epoch_h__
@@ -0,0 +1,74 @@
+#ifndef __fsem_h__
+#define __fsem_h__
+
+// Counting semaphore built directly on the futex syscall.
+//
+// value is the number of available units and never goes negative. wait
+// takes a unit with a CAS, so while value > 0 neither wait nor post enters
+// the kernel. Only a waiter that finds value == 0 sleeps on the futex, and
+// post only makes the wake syscall when someone is counted in waiters.
+//
+// trywait and timedwait follow sem_trywait/sem_timedwait: they return -1
+// with errno set to EAGAIN or ETIMEDOUT (abstime is on CLOCK_REALTIME).
+
+#include <errno.h>
+#include <time.h>
+#include <stdatomic.h>
+#include "common_threads.h"
+
+typedef struct _fsem_t {
+	atomic_int value;
+	atomic_int waiters;
+} fsem_t;
+
+void fsem_init(fsem_t *s, int value) {
+	atomic_init(&s->value, value);
+	atomic_init(&s->waiters, 0);
+}
+
+int fsem_trywait(fsem_t *s) {
+	int v = atomic_load_explicit(&s->value, memory_order_relaxed);
+	while(v > 0) {
+		if(atomic_compare_exchange_weak_explicit(&s->value, &v, v - 1,
+					memory_order_acquire, memory_order_relaxed))
+			return 0;
+	}
+	errno = EAGAIN;
+	return -1;
+}
+
+// abstime == NULL waits forever.
+int fsem_timedwait(fsem_t *s, const struct timespec *abstime) {
+	while(fsem_trywait(s) != 0) {
+		atomic_fetch_add(&s->waiters, 1);
+		// Sleeps only if value is still 0; a post in between makes this
+		// return at once, since post bumps value before reading waiters.
+		long rc = syscall(SYS_futex, &s->value, FUTEX_WAIT_BITSET_PRIVATE | FUTEX_CLOCK_REALTIME,
+				0, abstime, NULL, FUTEX_BITSET_MATCH_ANY);
+		int err = errno;
+		atomic_fetch_sub(&s->waiters, 1);
+		if(rc == -1 && err == ETIMEDOUT) {
+			if(fsem_trywait(s) == 0)
+				return 0;
+			errno = ETIMEDOUT;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void fsem_wait(fsem_t *s) {
+	fsem_timedwait(s, NULL);
+}
+
+void fsem_post_n(fsem_t *s, int n) {
+	atomic_fetch_add_explicit(&s->value, n, memory_order_seq_cst);
+	if(atomic_load(&s->waiters) > 0)
+		Futex_wake(&s->value, n);
+}
+
+void fsem_post(fsem_t *s) {
+	fsem_post_n(s, 1);
+}
+
+#endif // __fsem_h__
@@ -0,0 +1,144 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <math.h>
+#include "common.h"
+#include "common_threads.h"
+#include "spinlock.h"
+
+// The counter++ workload of threads-safe.c under a swappable lock. Threads
+// hammer the lock for <secs> seconds and we report:
+//   Macq/s    total acquisitions per second
+//   cv        fairness: stddev / mean of per-thread acquisition counts
+//   xcpu      % of handoffs where the next holder ran on another CPU
+//   xnode     % of handoffs that crossed NUMA nodes (i.e. sockets)
+// The last two count how often the lock and counter cache lines had to move
+// between cores and between sockets.
+//
+// usage: lock-bench [lock|all] [threads] [secs]
+//        lock is one of pthread ttas ticket mcs clh
+
+#define MAX_CPUS 1024
+
+volatile long long counter = 0;
+volatile int stop = 0;
+int last_cpu = -1;
+long long xcpu = 0, xnode = 0;
+int node_of[MAX_CPUS];
+
+int kind;		// SPIN_* or SPIN_KINDS for pthread mutex
+spinlock_t lock;
+pthread_mutex_t m = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct _stat_t {
+	_Alignas(CACHELINE) long long acquired;
+} stat_t;
+
+// Parse /sys/devices/system/node/node*/cpulist ("0-3,8-11") into node_of.
+void read_numa_nodes() {
+	memset(node_of, 0, sizeof(node_of));
+	for(int node = 0; ; node++) {
+		char path[64];
+		sprintf(path, "/sys/devices/system/node/node%d/cpulist", node);
+		FILE *f = fopen(path, "r");
+		if(f == NULL)
+			return;
+		int lo, hi;
+		while(fscanf(f, "%d", &lo) == 1) {
+			hi = lo;
+			if(fgetc(f) == '-') {
+				if(fscanf(f, "%d", &hi) != 1)
+					break;
+				fgetc(f);
+			}
+			for(int c = lo; c <= hi && c < MAX_CPUS; c++)
+				node_of[c] = node;
+		}
+		fclose(f);
+	}
+}
+
+void *worker(void *arg) {
+	stat_t *st = (stat_t*) arg;
+	spin_ctx_t ctx;
+	spin_ctx_init(&ctx);
+	while(!stop) {
+		if(kind == SPIN_KINDS)
+			pthread_mutex_lock(&m);
+		else
+			spin_lock(&lock, &ctx);
+
+		counter++;
+		int cpu = sched_getcpu();
+		if(cpu != last_cpu && last_cpu >= 0) {
+			xcpu++;
+			if(cpu < MAX_CPUS && last_cpu < MAX_CPUS && node_of[cpu] != node_of[last_cpu])
+				xnode++;
+		}
+		last_cpu = cpu;
+
+		if(kind == SPIN_KINDS)
+			pthread_mutex_unlock(&m);
+		else
+			spin_unlock(&lock, &ctx);
+		st->acquired++;
+	}
+	spin_ctx_destroy(&ctx);
+	return NULL;
+}
+
+void run(int k, int nthreads, double secs) {
+	pthread_t p[nthreads];
+	stat_t *st = aligned_alloc(CACHELINE, nthreads * sizeof(stat_t));
+	assert(st != NULL);
+	kind = k;
+	if(k < SPIN_KINDS)
+		spin_init(&lock, k);
+	counter = 0;
+	stop = 0;
+	last_cpu = -1;
+	xcpu = xnode = 0;
+	for(int i = 0; i < nthreads; i++) {
+		st[i].acquired = 0;
+		Pthread_create(&p[i], NULL, worker, &st[i]);
+	}
+	double t = GetTime();
+	usleep(secs * 1e6);
+	stop = 1;
+	for(int i = 0; i < nthreads; i++)
+		Pthread_join(p[i], NULL);
+	t = GetTime() - t;
+
+	long long total = 0;
+	for(int i = 0; i < nthreads; i++)
+		total += st[i].acquired;
+	if(total != counter) {
+		printf("oops! counter is %lld, expected %lld\n", counter, total);
+		exit(-1);
+	}
+	double mean = (double) total / nthreads, var = 0;
+	for(int i = 0; i < nthreads; i++)
+		var += (st[i].acquired - mean) * (st[i].acquired - mean);
+	var /= nthreads;
+	printf("%-8s %7d %10.2f %8.3f %7.2f%% %7.2f%%\n",
+			k < SPIN_KINDS ? spin_names[k] : "pthread", nthreads,
+			total / t / 1e6, mean > 0 ? sqrt(var) / mean : 0,
+			total ? 100.0 * xcpu / total : 0, total ? 100.0 * xnode / total : 0);
+	free(st);
+}
+
+int main(int argc, char *argv[]) {
+	const char *which = argc > 1 ? argv[1] : "all";
+	int nthreads = argc > 2 ? atoi(argv[2]) : sysconf(_SC_NPROCESSORS_ONLN);
+	double secs = argc > 3 ? atof(argv[3]) : 1;
+	read_numa_nodes();
+	printf("%-8s %7s %10s %8s %8s %8s\n", "lock", "threads", "Macq/s", "cv", "xcpu", "xnode");
+	for(int k = 0; k <= SPIN_KINDS; k++) {
+		const char *name = k < SPIN_KINDS ? spin_names[k] : "pthread";
+		if(strcmp(which, "all") == 0 || strcmp(which, name) == 0)
+			run(k, nthreads, secs);
+	}
+	return 0;
+}
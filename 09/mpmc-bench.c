@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <semaphore.h>
+#include "common.h"
+#include "common_threads.h"
+#include "mpmc.h"
+
+// Sweeps producers x consumers over 1, 2, 4, ... <max> threads and reports
+// Mops/sec for the two-semaphore-plus-two-lock pipe of sem-mpmc.c and for the
+// per-slot sequence-number queue of mpmc.h. Each producer sends its share of
+// <items> ints; consumers stop at a -1 sentinel pushed once producers finish.
+//
+// usage: mpmc-bench [max threads] [items]
+
+#define SZ 10
+#define QSZ 1024
+
+// sem-mpmc.c's pipe, carrying ints instead of chars.
+volatile int buf[SZ];
+volatile int reader = 0;
+volatile int writer = 0;
+
+sem_t write_slots;
+sem_t read_slots;
+sem_t read_lock;
+sem_t write_lock;
+
+void pipe_write(int c) {
+	sem_wait(&write_slots);
+	sem_wait(&write_lock);
+	buf[writer] = c;
+	writer = (writer + 1)%SZ;
+	sem_post(&write_lock);
+	sem_post(&read_slots);
+}
+
+int pipe_read() {
+	sem_wait(&read_slots);
+	sem_wait(&read_lock);
+	int c = buf[reader];
+	reader = (reader + 1)%SZ;
+	sem_post(&read_lock);
+	sem_post(&write_slots);
+	return c;
+}
+
+mpmc_t q;
+int use_mpmc;
+long per_producer;
+
+void put(int v) {
+	if(use_mpmc)
+		mpmc_push(&q, &v);
+	else
+		pipe_write(v);
+}
+
+int get() {
+	int v;
+	if(use_mpmc)
+		mpmc_pop(&q, &v);
+	else
+		v = pipe_read();
+	return v;
+}
+
+void *producer(void *arg) {
+	for(long i = 0; i < per_producer; i++)
+		put(i & 0xff);
+	return NULL;
+}
+
+void *consumer(void *arg) {
+	long sum = 0;
+	int v;
+	while((v = get()) != -1)
+		sum += v;
+	*(long*) arg = sum;
+	return NULL;
+}
+
+double run(int mode, int np, int nc, long items) {
+	pthread_t p[np], c[nc];
+	long sums[nc];
+	use_mpmc = mode;
+	per_producer = items / np;
+	reader = writer = 0;
+	sem_init(&write_slots, 0, SZ);
+	sem_init(&read_slots, 0, 0);
+	sem_init(&write_lock, 0, 1);
+	sem_init(&read_lock, 0, 1);
+	mpmc_init(&q, QSZ, sizeof(int));
+
+	double t = GetTime();
+	for(int i = 0; i < nc; i++)
+		Pthread_create(&c[i], NULL, consumer, &sums[i]);
+	for(int i = 0; i < np; i++)
+		Pthread_create(&p[i], NULL, producer, NULL);
+	for(int i = 0; i < np; i++)
+		Pthread_join(p[i], NULL);
+	for(int i = 0; i < nc; i++)
+		put(-1);
+	long sum = 0;
+	for(int i = 0; i < nc; i++) {
+		Pthread_join(c[i], NULL);
+		sum += sums[i];
+	}
+	t = GetTime() - t;
+
+	long want = 0;
+	for(long i = 0; i < per_producer; i++)
+		want += i & 0xff;
+	if(sum != want * np) {
+		printf("oops! sum is %ld, expected %ld\n", sum, want * np);
+		exit(-1);
+	}
+	mpmc_destroy(&q);
+	return per_producer * np / t / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+	int max = argc > 1 ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+	long items = argc > 2 ? atol(argv[2]) : 1000000;
+	printf("%4s %4s %14s %14s\n", "P", "C", "sem Mops/s", "mpmc Mops/s");
+	for(int np = 1; np <= max; np = np < max && np * 2 > max ? max : np * 2) {
+		for(int nc = 1; nc <= max; nc = nc < max && nc * 2 > max ? max : nc * 2) {
+			double s = run(0, np, nc, items);
+			double m = run(1, np, nc, items);
+			printf("%4d %4d %14.2f %14.2f\n", np, nc, s, m);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,155 @@
+#ifndef __mpmc_h__
+#define __mpmc_h__
+
+// Bounded multi-producer/multi-consumer queue (Dmitry Vyukov's design).
+//
+// Every cell carries a sequence number that says whose turn it is:
+//   seq == pos       cell is free for the producer that claims ticket pos
+//   seq == pos + 1   cell holds the element for the consumer with ticket pos
+// Producers claim tickets with a CAS on enq and consumers on deq, so the two
+// sides never share a lock and, unlike sem-mpmc.c, producers never wait on
+// consumers (or each other) unless the queue is actually full.
+//
+// Elements are copied in and out, so any element size works. Blocking
+// calls spin first and only sleep on a futex when the queue is truly empty
+// (or full); the other side only makes a syscall if someone is asleep.
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "common_threads.h"
+
+#define MPMC_SPINS 256		// retries before sleeping on the futex
+#define MPMC_DATA 8		// offset of the element inside a cell
+
+typedef struct _mpmc_t {
+	_Alignas(CACHELINE) atomic_uint enq;	// next ticket for producers
+	_Alignas(CACHELINE) atomic_uint deq;	// next ticket for consumers
+	_Alignas(CACHELINE) atomic_uint push_ev;	// bumped to wake sleeping consumers
+	atomic_int rwaiters;
+	_Alignas(CACHELINE) atomic_uint pop_ev;	// bumped to wake sleeping producers
+	atomic_int wwaiters;
+	_Alignas(CACHELINE) unsigned mask;
+	unsigned esize;
+	unsigned stride;
+	char *cells;
+} mpmc_t;
+
+#define MPMC_SEQ(q, pos) ((atomic_uint*) ((q)->cells + ((pos) & (q)->mask) * (q)->stride))
+
+// size must be a power of 2.
+void mpmc_init(mpmc_t *q, unsigned size, unsigned esize) {
+	assert(size > 0 && (size & (size - 1)) == 0);
+	q->mask = size - 1;
+	q->esize = esize;
+	q->stride = (MPMC_DATA + esize + 7) & ~7u;
+	q->cells = aligned_alloc(CACHELINE, ((size * q->stride) + CACHELINE - 1) & ~(CACHELINE - 1));
+	assert(q->cells != NULL);
+	for(unsigned i = 0; i < size; i++)
+		atomic_init(MPMC_SEQ(q, i), i);
+	atomic_init(&q->enq, 0);
+	atomic_init(&q->deq, 0);
+	atomic_init(&q->push_ev, 0);
+	atomic_init(&q->pop_ev, 0);
+	atomic_init(&q->rwaiters, 0);
+	atomic_init(&q->wwaiters, 0);
+}
+
+void mpmc_destroy(mpmc_t *q) {
+	free(q->cells);
+}
+
+// After a successful operation: wake one sleeper of the other side, if any.
+void mpmc_notify(atomic_uint *ev, atomic_int *waiters) {
+	atomic_thread_fence(memory_order_seq_cst);
+	if(atomic_load_explicit(waiters, memory_order_relaxed) > 0) {
+		atomic_fetch_add(ev, 1);
+		Futex_wake(ev, 1);
+	}
+}
+
+// Returns 0 if the queue is full.
+int mpmc_try_push(mpmc_t *q, const void *e) {
+	unsigned pos = atomic_load_explicit(&q->enq, memory_order_relaxed);
+	atomic_uint *seq;
+	while(1) {
+		seq = MPMC_SEQ(q, pos);
+		int dif = (int) (atomic_load_explicit(seq, memory_order_acquire) - pos);
+		if(dif == 0) {
+			if(atomic_compare_exchange_weak_explicit(&q->enq, &pos, pos + 1,
+						memory_order_relaxed, memory_order_relaxed))
+				break;
+		} else if(dif < 0) {
+			return 0;
+		} else {
+			pos = atomic_load_explicit(&q->enq, memory_order_relaxed);
+		}
+	}
+	memcpy((char*) seq + MPMC_DATA, e, q->esize);
+	atomic_store_explicit(seq, pos + 1, memory_order_release);
+	mpmc_notify(&q->push_ev, &q->rwaiters);
+	return 1;
+}
+
+// Returns 0 if the queue is empty.
+int mpmc_try_pop(mpmc_t *q, void *e) {
+	unsigned pos = atomic_load_explicit(&q->deq, memory_order_relaxed);
+	atomic_uint *seq;
+	while(1) {
+		seq = MPMC_SEQ(q, pos);
+		int dif = (int) (atomic_load_explicit(seq, memory_order_acquire) - (pos + 1));
+		if(dif == 0) {
+			if(atomic_compare_exchange_weak_explicit(&q->deq, &pos, pos + 1,
+						memory_order_relaxed, memory_order_relaxed))
+				break;
+		} else if(dif < 0) {
+			return 0;
+		} else {
+			pos = atomic_load_explicit(&q->deq, memory_order_relaxed);
+		}
+	}
+	memcpy(e, (char*) seq + MPMC_DATA, q->esize);
+	atomic_store_explicit(seq, pos + q->mask + 1, memory_order_release);
+	mpmc_notify(&q->pop_ev, &q->wwaiters);
+	return 1;
+}
+
+int mpmc_try(mpmc_t *q, void *e, int push) {
+	return push ? mpmc_try_push(q, e) : mpmc_try_pop(q, e);
+}
+
+// Retry a push (or pop) until it succeeds, sleeping on the futex of the
+// other side when the queue stays full (or empty).
+void mpmc_block(mpmc_t *q, void *e, int push) {
+	atomic_uint *ev = push ? &q->pop_ev : &q->push_ev;
+	atomic_int *waiters = push ? &q->wwaiters : &q->rwaiters;
+	for(int i = 0; i < MPMC_SPINS; i++) {
+		if(mpmc_try(q, e, push))
+			return;
+		cpu_relax();
+	}
+	while(1) {
+		// Read ev before announcing ourselves: if the other side makes
+		// progress after our last try, it sees waiters > 0 and bumps ev,
+		// so the futex wait below returns immediately.
+		unsigned v = atomic_load(ev);
+		atomic_fetch_add(waiters, 1);
+		atomic_thread_fence(memory_order_seq_cst);	// pairs with mpmc_notify
+		int ok = mpmc_try(q, e, push);
+		if(!ok)
+			Futex_wait(ev, v);
+		atomic_fetch_sub(waiters, 1);
+		if(ok || mpmc_try(q, e, push))
+			return;
+	}
+}
+
+void mpmc_push(mpmc_t *q, const void *e) {
+	mpmc_block(q, (void*) e, 1);
+}
+
+void mpmc_pop(mpmc_t *q, void *e) {
+	mpmc_block(q, e, 0);
+}
+
+#endif // __mpmc_h__
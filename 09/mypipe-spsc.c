@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "common.h"
+#include "common_threads.h"
+#include "spsc.h"
+
+// Same producer/consumer as mypipe.c, but over the lock-free ring in spsc.h.
+// There is exactly one producer and one consumer, so no mutex is needed.
+
+spsc_t q;
+
+void pipe_write(char c) {
+	spsc_write(&q, c);
+}
+
+char pipe_read() {
+	return spsc_read(&q);
+}
+
+void pipe_write_n(const char *s, int n) {
+	spsc_write_n(&q, s, n);
+}
+
+int pipe_read_n(char *s, int n) {
+	return spsc_read_n(&q, s, n);
+}
+
+void *consumer(void *arg) { 
+	char s[26];
+	while(1) {
+		sleep(1);
+		int n = pipe_read_n(s, sizeof(s));
+		for(int i = 0; i < n; i++)
+			printf("%c", s[i] - 'a' + 'A');
+		printf("\n");
+	}
+	return NULL; 
+}
+
+void *producer(void *arg) {
+	char s[26];
+	for(int i = 0; i < 26; i++)
+		s[i] = 'a' + i;
+	while(1) {
+		pipe_write_n(s, sizeof(s));
+	}
+	return NULL; 
+}
+
+int main(int argc, char *argv[]) { 
+	pthread_t p, c; 
+	spsc_init(&q);
+	pthread_create(&p, NULL, producer, NULL);
+	pthread_create(&c, NULL, consumer, NULL);
+	pthread_join(p, NULL);
+	pthread_join(c, NULL);
+	return 0;
+}
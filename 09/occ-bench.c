@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "common.h"
+#include "common_threads.h"
+#include "occ.h"
+
+// Bank transfers as in dead-fix.c, with two engines:
+//   mutex  a pthread mutex per account, taken in id order (dead-fix.c)
+//   occ    occ.h: batches of BATCH transfers committed optimistically
+// for 10 .. <max accounts> accounts and three contention levels: the share of
+// transfers that go between HOT fixed accounts (0%, 50%, 90%). Every thread
+// runs <txns> transfers. After each run the total balance must be unchanged.
+//
+// usage: occ-bench [threads] [txns per thread] [max accounts]
+
+#define BATCH 32
+#define HOT 4
+#define START 1000
+
+typedef struct _account_t {
+	int id;
+	pthread_mutex_t lock;
+	int balance;
+} account_t;
+
+account_t *accs;
+oacct_t *oaccs;
+int naccs;
+int hot_pct;
+int txns;
+int engine;
+
+void transfer(account_t *src, account_t *dst, int amount) {
+	if(src->id < dst->id) {
+		pthread_mutex_lock(&src->lock);
+		pthread_mutex_lock(&dst->lock);
+	} else {
+		pthread_mutex_lock(&dst->lock);
+		pthread_mutex_lock(&src->lock);
+	}
+	if(src->balance > amount) {
+		dst->balance += amount;
+		src->balance -= amount;
+	}
+	pthread_mutex_unlock(&src->lock);
+	pthread_mutex_unlock(&dst->lock);
+}
+
+void pick(unsigned *seed, otxn_t *t) {
+	int n = naccs;
+	if(naccs > HOT && rand_r(seed) % 100 < hot_pct)
+		n = HOT;
+	t->src = rand_r(seed) % n;
+	do {
+		t->dst = rand_r(seed) % n;
+	} while(t->dst == t->src);
+	t->amount = 1 + rand_r(seed) % 20;
+}
+
+void *worker(void *arg) {
+	occ_stats_t *st = (occ_stats_t*) arg;
+	unsigned seed = (unsigned) (long) st;
+	otxn_t b[BATCH];
+	for(int i = 0; i < txns; i += BATCH) {
+		int n = txns - i < BATCH ? txns - i : BATCH;
+		for(int k = 0; k < n; k++)
+			pick(&seed, &b[k]);
+		if(engine == 0) {
+			for(int k = 0; k < n; k++)
+				transfer(&accs[b[k].src], &accs[b[k].dst], b[k].amount);
+		} else {
+			occ_apply(oaccs, b, n, st);
+		}
+	}
+	return NULL;
+}
+
+double run(int eng, int nthreads, double *abort_pct) {
+	pthread_t p[nthreads];
+	occ_stats_t st[nthreads];
+	engine = eng;
+	for(int i = 0; i < naccs; i++) {
+		accs[i].id = i;
+		pthread_mutex_init(&accs[i].lock, NULL);
+		accs[i].balance = START;
+		atomic_init(&oaccs[i].ver, 0);
+		atomic_init(&oaccs[i].balance, START);
+	}
+	double t = GetTime();
+	for(int i = 0; i < nthreads; i++) {
+		st[i].commits = st[i].aborts = 0;
+		Pthread_create(&p[i], NULL, worker, &st[i]);
+	}
+	long long commits = 0, aborts = 0;
+	for(int i = 0; i < nthreads; i++) {
+		Pthread_join(p[i], NULL);
+		commits += st[i].commits;
+		aborts += st[i].aborts;
+	}
+	t = GetTime() - t;
+
+	long long total = 0;
+	for(int i = 0; i < naccs; i++) {
+		int b = eng == 0 ? accs[i].balance : atomic_load(&oaccs[i].balance);
+		if(b < 0) {
+			printf("oops! account %d has %d\n", i, b);
+			exit(-1);
+		}
+		total += b;
+		pthread_mutex_destroy(&accs[i].lock);
+	}
+	if(total != (long long) START * naccs) {
+		printf("oops! total balance is %lld, expected %lld\n", total, (long long) START * naccs);
+		exit(-1);
+	}
+	*abort_pct = commits + aborts > 0 ? 100.0 * aborts / (commits + aborts) : 0;
+	return (double) txns * nthreads / t / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+	int nthreads = argc > 1 ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+	txns = argc > 2 ? atoi(argv[2]) : 200000;
+	int max = argc > 3 ? atoi(argv[3]) : 1000000;
+	int hots[] = { 0, 50, 90 };
+	accs = malloc(max * sizeof(account_t));
+	oaccs = malloc(max * sizeof(oacct_t));
+	assert(accs != NULL && oaccs != NULL);
+	printf("%9s %5s %12s %12s %9s\n", "accounts", "hot%", "mutex Mtx/s", "occ Mtx/s", "aborts%");
+	for(naccs = 10; naccs <= max; naccs *= 10) {
+		for(int h = 0; h < 3; h++) {
+			double ab;
+			hot_pct = hots[h];
+			double m = run(0, nthreads, &ab);
+			double o = run(1, nthreads, &ab);
+			printf("%9d %5d %12.2f %12.2f %9.2f\n", naccs, hot_pct, m, o, ab);
+		}
+	}
+	free(accs);
+	free(oaccs);
+	return 0;
+}
@@ -0,0 +1,129 @@
+#ifndef __occ_h__
+#define __occ_h__
+
+// Optimistic, batched transfer engine for the dead-fix.c bank.
+//
+// Instead of a mutex, every account carries a version number that is odd
+// while a commit is writing it. A worker applies a whole batch of transfers
+// at once:
+//   1. read the version and balance of every account the batch touches
+//   2. run the transfers in order against private copies of the balances
+//   3. commit: CAS each version from the value read in step 1 to odd, in
+//      account id order. A failed CAS means someone else committed in the
+//      meantime, so undo the CASes done so far and start over (an abort).
+//   4. write the new balances and bump each version to the next even value
+// Nobody ever sleeps holding an account, and an account touched by many
+// transfers in one batch is only validated and written once.
+
+#include <stdatomic.h>
+#include "common_threads.h"
+
+#define OCC_MAX_BATCH 64
+
+typedef struct _oacct_t {
+	atomic_uint ver;		// odd while being committed
+	atomic_int balance;
+} oacct_t;
+
+typedef struct _otxn_t {
+	int src;
+	int dst;
+	int amount;
+} otxn_t;
+
+typedef struct _occ_stats_t {
+	long long commits;
+	long long aborts;
+} occ_stats_t;
+
+// Insert id into the sorted set ids[0..n-1]; returns the new size.
+int occ_add_id(int *ids, int n, int id) {
+	int i = n;
+	while(i > 0 && ids[i - 1] > id)
+		i--;
+	if(i > 0 && ids[i - 1] == id)
+		return n;
+	for(int k = n; k > i; k--)
+		ids[k] = ids[k - 1];
+	ids[i] = id;
+	return n + 1;
+}
+
+int occ_find(const int *ids, int n, int id) {
+	int lo = 0, hi = n - 1;
+	while(lo < hi) {
+		int mid = (lo + hi) / 2;
+		if(ids[mid] < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+// Apply t[0..n-1] (n <= OCC_MAX_BATCH) atomically and in order.
+void occ_apply(oacct_t *accs, const otxn_t *t, int n, occ_stats_t *st) {
+	int ids[2 * OCC_MAX_BATCH];
+	unsigned ver[2 * OCC_MAX_BATCH];
+	int bal[2 * OCC_MAX_BATCH];
+	int m = 0;
+	assert(n <= OCC_MAX_BATCH);
+	for(int i = 0; i < n; i++) {
+		m = occ_add_id(ids, m, t[i].src);
+		m = occ_add_id(ids, m, t[i].dst);
+	}
+	while(1) {
+		// 1. consistent snapshot of each account
+		for(int i = 0; i < m; i++) {
+			oacct_t *a = &accs[ids[i]];
+			unsigned v;
+			do {
+				// A committer holds it for a few stores; yield in
+				// case it got preempted.
+				for(int k = 1; (v = atomic_load_explicit(&a->ver, memory_order_acquire)) & 1; k++) {
+					cpu_relax();
+					if(k % 1024 == 0)
+						sched_yield();
+				}
+				bal[i] = atomic_load_explicit(&a->balance, memory_order_relaxed);
+				atomic_thread_fence(memory_order_acquire);
+			} while(atomic_load_explicit(&a->ver, memory_order_relaxed) != v);
+			ver[i] = v;
+		}
+		// 2. run the batch privately, with dead-fix.c's rule
+		int newbal[2 * OCC_MAX_BATCH];
+		for(int i = 0; i < m; i++)
+			newbal[i] = bal[i];
+		for(int i = 0; i < n; i++) {
+			int s = occ_find(ids, m, t[i].src), d = occ_find(ids, m, t[i].dst);
+			if(newbal[s] > t[i].amount) {
+				newbal[d] += t[i].amount;
+				newbal[s] -= t[i].amount;
+			}
+		}
+		// 3. validate and claim, in id order
+		int got = 0;
+		for(; got < m; got++) {
+			unsigned v = ver[got];
+			if(!atomic_compare_exchange_strong_explicit(&accs[ids[got]].ver, &v, v + 1,
+						memory_order_acquire, memory_order_relaxed))
+				break;
+		}
+		if(got < m) {
+			for(int i = 0; i < got; i++)
+				atomic_store_explicit(&accs[ids[i]].ver, ver[i], memory_order_release);
+			st->aborts++;
+			cpu_relax();
+			continue;
+		}
+		// 4. publish
+		for(int i = 0; i < m; i++) {
+			atomic_store_explicit(&accs[ids[i]].balance, newbal[i], memory_order_relaxed);
+			atomic_store_explicit(&accs[ids[i]].ver, ver[i] + 2, memory_order_release);
+		}
+		st->commits++;
+		return;
+	}
+}
+
+#endif // __occ_h__
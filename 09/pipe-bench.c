@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "common.h"
+#include "common_threads.h"
+#include "spsc.h"
+
+// Moves <items> chars from one producer to one consumer and reports ops/sec
+// for the mutex/CV pipe of mypipe.c and for the lock-free ring of spsc.h,
+// first one char per call and then <batch> chars per call.
+//
+// usage: pipe-bench [items] [batch]
+
+#define SZ 10
+
+// mutex/CV pipe, as in mypipe.c (with while loops so it survives spurious
+// wakeups and two-sided waiting).
+volatile char buf[SZ];
+volatile int reader = 0;
+volatile int writer = 0;
+
+pthread_cond_t empty = PTHREAD_COND_INITIALIZER;
+pthread_cond_t full = PTHREAD_COND_INITIALIZER;
+pthread_mutex_t m = PTHREAD_MUTEX_INITIALIZER;
+
+void pipe_write(char c) {
+	pthread_mutex_lock(&m);
+	while((writer + 1) % SZ == reader)
+		pthread_cond_wait(&full, &m);
+	buf[writer] = c;
+	writer = (writer + 1)%SZ;
+	pthread_mutex_unlock(&m);
+	pthread_cond_signal(&empty);
+}
+
+char pipe_read() {
+	pthread_mutex_lock(&m);
+	while(reader == writer)
+		pthread_cond_wait(&empty, &m);
+	char c = buf[reader];
+	reader = (reader + 1)%SZ;
+	pthread_mutex_unlock(&m);
+	pthread_cond_signal(&full);
+	return c;
+}
+
+spsc_t q;
+long items;
+int batch;
+int mode;	// 0: mutex/CV, 1: spsc one char, 2: spsc batched
+
+void *producer(void *arg) {
+	char s[batch];
+	for(long i = 0; i < items; ) {
+		if(mode == 0) {
+			pipe_write('a' + i % 26);
+			i++;
+		} else if(mode == 1) {
+			spsc_write(&q, 'a' + i % 26);
+			i++;
+		} else {
+			int n = items - i < batch ? items - i : batch;
+			for(int k = 0; k < n; k++)
+				s[k] = 'a' + (i + k) % 26;
+			spsc_write_n(&q, s, n);
+			i += n;
+		}
+	}
+	return NULL;
+}
+
+void *consumer(void *arg) {
+	char s[batch];
+	long sum = 0;
+	for(long i = 0; i < items; ) {
+		if(mode == 0) {
+			sum += pipe_read();
+			i++;
+		} else if(mode == 1) {
+			sum += spsc_read(&q);
+			i++;
+		} else {
+			int n = spsc_read_n(&q, s, batch);
+			for(int k = 0; k < n; k++)
+				sum += s[k];
+			i += n;
+		}
+	}
+	*(long*) arg = sum;
+	return NULL;
+}
+
+void run(const char *name, int md) {
+	pthread_t p, c;
+	long sum;
+	mode = md;
+	spsc_init(&q);
+	double t = GetTime();
+	Pthread_create(&p, NULL, producer, NULL);
+	Pthread_create(&c, NULL, consumer, &sum);
+	Pthread_join(p, NULL);
+	Pthread_join(c, NULL);
+	t = GetTime() - t;
+	printf("%-16s: %10.0f ops/sec (checksum %ld)\n", name, items / t, sum);
+}
+
+int main(int argc, char *argv[]) {
+	items = argc > 1 ? atol(argv[1]) : 10000000;
+	batch = argc > 2 ? atoi(argv[2]) : 64;
+	assert(batch > 0);
+	run("mutex/cv", 0);
+	run("spsc", 1);
+	run("spsc batched", 2);
+	return 0;
+}
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "common.h"
+#include "common_threads.h"
+#include "pool.h"
+
+// The dead-fix.c transfer workload, once with a thread per transaction and
+// once as tasks on the pool of pool.h, for TXNS = 100, 1000, ... <max txns>.
+// Reports transactions/sec and checks that no money was created or lost.
+// The printfs inside transfer are gone: they would dominate both versions.
+// The thread-per-txn baseline creates at most WAVE threads before joining
+// them, since a million live threads would just fail, and gives each a
+// STACK-byte stack: with the default 8 MB, a wave of them does not fit in
+// the 4 GB address space of the -m32 build.
+//
+// usage: pool-bench [workers] [max txns]
+
+#define ACCS 10
+#define WAVE 1000
+#define STACK (64 * 1024)
+
+typedef struct _account_t {
+	int id;
+	pthread_mutex_t lock;
+	int balance;
+} account_t;
+
+typedef struct _txn_t {
+	int id;
+	account_t* src;
+	account_t* dst;
+	int amount;
+	pthread_t thr;
+	task_t task;
+} txn_t;
+
+void transfer(void* arg) {
+	txn_t* t = (txn_t*) arg;
+
+	if(t->src->id < t->dst->id) {
+		pthread_mutex_lock(&t->src->lock);
+		pthread_mutex_lock(&t->dst->lock);
+	} else {
+		pthread_mutex_lock(&t->dst->lock);
+		pthread_mutex_lock(&t->src->lock);
+	}
+
+	if(t->src->balance > t->amount) {
+		t->dst->balance += t->amount;
+		t->src->balance -= t->amount;
+	}
+
+	pthread_mutex_unlock(&t->src->lock);
+	pthread_mutex_unlock(&t->dst->lock);
+}
+
+void* transfer_thread(void* arg) {
+	transfer(arg);
+	return NULL;
+}
+
+account_t accs[ACCS];
+
+txn_t *make_txns(long n) {
+	txn_t *t = malloc(n * sizeof(txn_t));
+	assert(t != NULL);
+	for(int i = 0; i < ACCS; i++) {
+		pthread_mutex_init(&accs[i].lock, NULL);
+		accs[i].balance = 1000;
+		accs[i].id = i;
+	}
+	for(long i = 0; i < n; i++) {
+		int s = rand() % ACCS;
+		int d = (i%ACCS);
+		if (s == d)
+			d = (s+1)%ACCS;
+		t[i].id = i;
+		t[i].src = &accs[s];
+		t[i].dst = &accs[d];
+		t[i].amount = 10;
+		t[i].task.fn = transfer;
+		t[i].task.arg = &t[i];
+	}
+	return t;
+}
+
+void check() {
+	int total = 0;
+	for(int i = 0; i < ACCS; i++)
+		total += accs[i].balance;
+	if(total != ACCS * 1000) {
+		printf("oops! total balance is %d\n", total);
+		exit(-1);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	int workers = argc > 1 ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+	long max = argc > 2 ? atol(argv[2]) : 1000000;
+	pool_t pool;
+	pool_init(&pool, workers);
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	int rc = pthread_attr_setstacksize(&attr, STACK);
+	assert(rc == 0);
+	printf("%10s %16s %16s\n", "TXNS", "thread/txn tx/s", "pool tx/s");
+	for(long n = 100; n <= max; n *= 10) {
+		txn_t *t = make_txns(n);
+		double start = GetTime();
+		for(long i = 0; i < n; i += WAVE) {
+			long end = i + WAVE < n ? i + WAVE : n;
+			for(long k = i; k < end; k++)
+				Pthread_create(&t[k].thr, &attr, transfer_thread, &t[k]);
+			for(long k = i; k < end; k++)
+				Pthread_join(t[k].thr, NULL);
+		}
+		double threads = n / (GetTime() - start);
+		check();
+		free(t);
+
+		t = make_txns(n);
+		start = GetTime();
+		for(long i = 0; i < n; i++)
+			pool_submit(&pool, &t[i].task);
+		pool_wait(&pool);
+		double pooled = n / (GetTime() - start);
+		check();
+		free(t);
+
+		printf("%10ld %16.0f %16.0f\n", n, threads, pooled);
+	}
+	pthread_attr_destroy(&attr);
+	pool_destroy(&pool);
+	return 0;
+}
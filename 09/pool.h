@@ -0,0 +1,296 @@
+#ifndef __pool_h__
+#define __pool_h__
+
+// Fixed-size thread pool with per-worker Chase-Lev work-stealing deques.
+//
+// Each worker pushes and pops tasks at the bottom of its own deque without
+// any atomic read-modify-write; idle workers steal from the top of someone
+// else's deque with one CAS. Tasks submitted from outside the pool go into a
+// mutex-protected injection queue that workers drain in batches into their
+// own deque. Workers with nothing to run or steal sleep on a futex.
+//
+// Tasks are intrusive: the caller embeds a task_t in its own struct (like the
+// pthread_t in dead-fix.c's txn_t) and it must stay alive until pool_wait.
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "common_threads.h"
+
+#define DEQUE_INIT 1024		// initial deque capacity, a power of 2
+#define INJECT_BATCH 32		// tasks a worker moves from the injection queue at once
+#define POOL_SPINS 64		// steal rounds before sleeping
+
+typedef struct _task_t {
+	void (*fn)(void *arg);
+	void *arg;
+	struct _task_t *next;		// injection queue link
+} task_t;
+
+typedef struct _deque_array_t {
+	long size;
+	struct _deque_array_t *prev;	// older arrays, freed with the pool
+	task_t *_Atomic buf[];
+} deque_array_t;
+
+typedef struct _deque_t {
+	_Alignas(CACHELINE) atomic_long top;	// thieves take from here
+	_Alignas(CACHELINE) atomic_long bottom;	// owner pushes and pops here
+	deque_array_t *_Atomic array;
+} deque_t;
+
+typedef struct _pool_t pool_t;
+
+typedef struct _worker_t {
+	deque_t dq;
+	pool_t *pool;
+	int id;
+	unsigned seed;
+	pthread_t thr;
+} worker_t;
+
+struct _pool_t {
+	int nworkers;
+	worker_t *w;
+	_Alignas(CACHELINE) atomic_long pending;	// submitted but not finished
+	atomic_int stop;
+	_Alignas(CACHELINE) atomic_uint work_ev;	// futex: bumped when work appears
+	atomic_int sleepers;
+	_Alignas(CACHELINE) pthread_mutex_t inject_lock;
+	task_t *inject_head, *inject_tail;
+	atomic_long injected;
+	pthread_mutex_t done_lock;
+	pthread_cond_t done;
+};
+
+__thread worker_t *pool_self = NULL;
+
+deque_array_t *deque_array_new(long size) {
+	deque_array_t *a = malloc(sizeof(deque_array_t) + size * sizeof(task_t*));
+	assert(a != NULL);
+	a->size = size;
+	a->prev = NULL;
+	return a;
+}
+
+void deque_init(deque_t *d) {
+	atomic_init(&d->top, 0);
+	atomic_init(&d->bottom, 0);
+	atomic_init(&d->array, deque_array_new(DEQUE_INIT));
+}
+
+void deque_destroy(deque_t *d) {
+	deque_array_t *a = atomic_load(&d->array);
+	while(a != NULL) {
+		deque_array_t *prev = a->prev;
+		free(a);
+		a = prev;
+	}
+}
+
+// Owner only.
+void deque_push(deque_t *d, task_t *t) {
+	long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+	long tp = atomic_load_explicit(&d->top, memory_order_acquire);
+	deque_array_t *a = atomic_load_explicit(&d->array, memory_order_relaxed);
+	if(b - tp > a->size - 1) {
+		// Full: copy into a twice-as-big array. Thieves may still be
+		// reading the old one, so keep it until the pool goes away.
+		deque_array_t *n = deque_array_new(2 * a->size);
+		for(long i = tp; i < b; i++)
+			atomic_store_explicit(&n->buf[i & (n->size - 1)],
+					atomic_load_explicit(&a->buf[i & (a->size - 1)], memory_order_relaxed),
+					memory_order_relaxed);
+		n->prev = a;
+		atomic_store_explicit(&d->array, n, memory_order_release);
+		a = n;
+	}
+	atomic_store_explicit(&a->buf[b & (a->size - 1)], t, memory_order_relaxed);
+	atomic_store_explicit(&d->bottom, b + 1, memory_order_release);
+}
+
+// Owner only. Returns NULL if empty.
+task_t *deque_pop(deque_t *d) {
+	long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+	deque_array_t *a = atomic_load_explicit(&d->array, memory_order_relaxed);
+	atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	long t = atomic_load_explicit(&d->top, memory_order_relaxed);
+	task_t *x = NULL;
+	if(t <= b) {
+		x = atomic_load_explicit(&a->buf[b & (a->size - 1)], memory_order_relaxed);
+		if(t == b) {
+			// Last task: race the thieves for it.
+			if(!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+						memory_order_seq_cst, memory_order_relaxed))
+				x = NULL;
+			atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+		}
+	} else {
+		atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+	}
+	return x;
+}
+
+// Any thread. Returns NULL if empty or if it lost a race.
+task_t *deque_steal(deque_t *d) {
+	long t = atomic_load_explicit(&d->top, memory_order_acquire);
+	atomic_thread_fence(memory_order_seq_cst);
+	long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+	if(t >= b)
+		return NULL;
+	deque_array_t *a = atomic_load_explicit(&d->array, memory_order_acquire);
+	task_t *x = atomic_load_explicit(&a->buf[t & (a->size - 1)], memory_order_relaxed);
+	if(!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+				memory_order_seq_cst, memory_order_relaxed))
+		return NULL;
+	return x;
+}
+
+void pool_notify(pool_t *p) {
+	atomic_thread_fence(memory_order_seq_cst);
+	if(atomic_load_explicit(&p->sleepers, memory_order_relaxed) > 0) {
+		atomic_fetch_add(&p->work_ev, 1);
+		Futex_wake(&p->work_ev, 1);
+	}
+}
+
+void pool_submit(pool_t *p, task_t *t) {
+	atomic_fetch_add_explicit(&p->pending, 1, memory_order_relaxed);
+	if(pool_self != NULL && pool_self->pool == p) {
+		deque_push(&pool_self->dq, t);
+	} else {
+		t->next = NULL;
+		pthread_mutex_lock(&p->inject_lock);
+		if(p->inject_tail != NULL)
+			p->inject_tail->next = t;
+		else
+			p->inject_head = t;
+		p->inject_tail = t;
+		atomic_fetch_add_explicit(&p->injected, 1, memory_order_relaxed);
+		pthread_mutex_unlock(&p->inject_lock);
+	}
+	pool_notify(p);
+}
+
+// Move up to INJECT_BATCH injected tasks into w's deque and return one.
+task_t *pool_take_injected(pool_t *p, worker_t *w) {
+	if(atomic_load_explicit(&p->injected, memory_order_relaxed) == 0)
+		return NULL;
+	pthread_mutex_lock(&p->inject_lock);
+	task_t *first = p->inject_head;
+	int n = 0;
+	if(first != NULL) {
+		task_t *t = first->next;
+		for(n = 1; t != NULL && n < INJECT_BATCH; n++) {
+			task_t *next = t->next;
+			deque_push(&w->dq, t);
+			t = next;
+		}
+		p->inject_head = t;
+		if(t == NULL)
+			p->inject_tail = NULL;
+		atomic_fetch_sub_explicit(&p->injected, n, memory_order_relaxed);
+	}
+	pthread_mutex_unlock(&p->inject_lock);
+	if(n > 1)
+		pool_notify(p);		// others can steal the rest
+	return first;
+}
+
+task_t *pool_find_work(pool_t *p, worker_t *w) {
+	task_t *t = deque_pop(&w->dq);
+	if(t == NULL)
+		t = pool_take_injected(p, w);
+	for(int i = 0; t == NULL && i < p->nworkers; i++) {
+		worker_t *v = &p->w[rand_r(&w->seed) % p->nworkers];
+		if(v != w)
+			t = deque_steal(&v->dq);
+	}
+	return t;
+}
+
+void pool_run(pool_t *p, task_t *t) {
+	t->fn(t->arg);
+	if(atomic_fetch_sub_explicit(&p->pending, 1, memory_order_acq_rel) == 1) {
+		pthread_mutex_lock(&p->done_lock);
+		pthread_cond_broadcast(&p->done);
+		pthread_mutex_unlock(&p->done_lock);
+	}
+}
+
+void *pool_worker(void *arg) {
+	worker_t *w = (worker_t*) arg;
+	pool_t *p = w->pool;
+	pool_self = w;
+	while(!atomic_load(&p->stop)) {
+		task_t *t = NULL;
+		for(int i = 0; t == NULL && i < POOL_SPINS; i++) {
+			t = pool_find_work(p, w);
+			if(t == NULL)
+				cpu_relax();
+		}
+		if(t != NULL) {
+			pool_run(p, t);
+			continue;
+		}
+		// Same eventcount handshake as mpmc.h: read ev, announce, recheck.
+		unsigned ev = atomic_load(&p->work_ev);
+		atomic_fetch_add(&p->sleepers, 1);
+		atomic_thread_fence(memory_order_seq_cst);
+		t = pool_find_work(p, w);
+		if(t == NULL && !atomic_load(&p->stop))
+			Futex_wait(&p->work_ev, ev);
+		atomic_fetch_sub(&p->sleepers, 1);
+		if(t != NULL)
+			pool_run(p, t);
+	}
+	return NULL;
+}
+
+void pool_init(pool_t *p, int nworkers) {
+	p->nworkers = nworkers;
+	// The deques are cache line aligned, which calloc does not promise.
+	p->w = aligned_alloc(CACHELINE, nworkers * sizeof(worker_t));
+	assert(p->w != NULL);
+	memset(p->w, 0, nworkers * sizeof(worker_t));
+	atomic_init(&p->pending, 0);
+	atomic_init(&p->stop, 0);
+	atomic_init(&p->work_ev, 0);
+	atomic_init(&p->sleepers, 0);
+	atomic_init(&p->injected, 0);
+	pthread_mutex_init(&p->inject_lock, NULL);
+	p->inject_head = p->inject_tail = NULL;
+	pthread_mutex_init(&p->done_lock, NULL);
+	pthread_cond_init(&p->done, NULL);
+	for(int i = 0; i < nworkers; i++) {
+		deque_init(&p->w[i].dq);
+		p->w[i].pool = p;
+		p->w[i].id = i;
+		p->w[i].seed = i + 1;
+	}
+	for(int i = 0; i < nworkers; i++)
+		Pthread_create(&p->w[i].thr, NULL, pool_worker, &p->w[i]);
+}
+
+// Wait until every submitted task has finished.
+void pool_wait(pool_t *p) {
+	pthread_mutex_lock(&p->done_lock);
+	while(atomic_load(&p->pending) != 0)
+		pthread_cond_wait(&p->done, &p->done_lock);
+	pthread_mutex_unlock(&p->done_lock);
+}
+
+void pool_destroy(pool_t *p) {
+	pool_wait(p);
+	atomic_store(&p->stop, 1);
+	atomic_fetch_add(&p->work_ev, 1);
+	Futex_wake(&p->work_ev, p->nworkers);
+	for(int i = 0; i < p->nworkers; i++)
+		Pthread_join(p->w[i].thr, NULL);
+	for(int i = 0; i < p->nworkers; i++)
+		deque_destroy(&p->w[i].dq);
+	free(p->w);
+}
+
+#endif // __pool_h__
@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "common.h"
+#include "common_threads.h"
+#include "reduce.h"
+
+// Sums an array of <n> ints <reps> times with each kernel in reduce.h, and
+// with the dispatched kernel on 1, 2, 4, ... <max> threads, and reports GB/s.
+// The first line is the original volatile loop from rw-ctr.c.
+//
+// usage: reduce-bench [n] [reps] [max threads]
+
+int *x;
+long n;
+int reps;
+
+int sum_volatile(const int *a, long len) {
+	volatile const int *v = a;
+	int s = 0;
+	for(long i = 0; i < len; i++)
+		s += v[i];
+	return s;
+}
+
+void report(const char *name, double t, int s, int want) {
+	if(s != want) {
+		printf("oops! %s sum is %d, expected %d\n", name, s, want);
+		exit(-1);
+	}
+	printf("%-20s %8.2f GB/s\n", name, (double) n * sizeof(int) * reps / t / 1e9);
+}
+
+void bench(const char *name, sum_fn_t fn, int want) {
+	int s = 0;
+	double t = GetTime();
+	for(int r = 0; r < reps; r++)
+		s = fn(x, n);
+	report(name, GetTime() - t, s, want);
+}
+
+int main(int argc, char *argv[]) {
+	n = argc > 1 ? atol(argv[1]) : 16 * 1024 * 1024;
+	reps = argc > 2 ? atoi(argv[2]) : 20;
+	int max = argc > 3 ? atoi(argv[3]) : sysconf(_SC_NPROCESSORS_ONLN);
+	x = malloc(n * sizeof(int));
+	assert(x != NULL);
+	for(long i = 0; i < n; i++)
+		x[i] = rand() % 1000 - 500;
+	int want = sum_scalar(x, n);
+
+	bench("volatile (rw-ctr)", sum_volatile, want);
+	bench("scalar", sum_scalar, want);
+#ifdef HAVE_X86_SIMD
+	if(__builtin_cpu_supports("avx2"))
+		bench("avx2", sum_avx2, want);
+	if(__builtin_cpu_supports("avx512f"))
+		bench("avx512", sum_avx512, want);
+#endif
+	bench("dispatched", sum_ints, want);
+
+	for(int th = 1; th <= max; th = th < max && th * 2 > max ? max : th * 2) {
+		char name[32];
+		sprintf(name, "parallel x%d", th);
+		int s = 0;
+		double t = GetTime();
+		for(int r = 0; r < reps; r++)
+			s = sum_ints_parallel(x, n, th, NULL);
+		report(name, GetTime() - t, s, want);
+	}
+	free(x);
+	return 0;
+}
@@ -0,0 +1,124 @@
+#ifndef __reduce_h__
+#define __reduce_h__
+
+// Sum of an int array, as in the sum() threads of rw-ctr.c.
+//
+// The x[] in rw-ctr.c is volatile, which forces one load per element and
+// keeps the compiler from vectorizing the loop. These kernels take a plain
+// const int* (the caller guarantees nothing changes underneath, e.g. by
+// holding the read lock) and add 8 (AVX2) or 16 (AVX-512) ints per
+// instruction. The sum wraps around like the original int s does.
+//
+// sum_ints() picks the widest kernel the CPU supports on first use;
+// sum_ints_parallel() splits the array across threads and adds the partial
+// sums.
+
+#include <stdint.h>
+#include <pthread.h>
+#include "common_threads.h"
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD
+#endif
+
+typedef int (*sum_fn_t)(const int *x, long n);
+
+int sum_scalar(const int *x, long n) {
+	uint32_t s = 0;
+	for(long i = 0; i < n; i++)
+		s += x[i];
+	return (int) s;
+}
+
+#ifdef HAVE_X86_SIMD
+__attribute__((target("avx2")))
+int sum_avx2(const int *x, long n) {
+	// Four independent accumulators hide the add latency.
+	__m256i a0 = _mm256_setzero_si256(), a1 = a0, a2 = a0, a3 = a0;
+	long i = 0;
+	for(; i + 32 <= n; i += 32) {
+		a0 = _mm256_add_epi32(a0, _mm256_loadu_si256((const __m256i*) (x + i)));
+		a1 = _mm256_add_epi32(a1, _mm256_loadu_si256((const __m256i*) (x + i + 8)));
+		a2 = _mm256_add_epi32(a2, _mm256_loadu_si256((const __m256i*) (x + i + 16)));
+		a3 = _mm256_add_epi32(a3, _mm256_loadu_si256((const __m256i*) (x + i + 24)));
+	}
+	a0 = _mm256_add_epi32(_mm256_add_epi32(a0, a1), _mm256_add_epi32(a2, a3));
+	__m128i h = _mm_add_epi32(_mm256_castsi256_si128(a0), _mm256_extracti128_si256(a0, 1));
+	h = _mm_add_epi32(h, _mm_shuffle_epi32(h, _MM_SHUFFLE(1, 0, 3, 2)));
+	h = _mm_add_epi32(h, _mm_shuffle_epi32(h, _MM_SHUFFLE(2, 3, 0, 1)));
+	return (int) ((uint32_t) _mm_cvtsi128_si32(h) + (uint32_t) sum_scalar(x + i, n - i));
+}
+
+__attribute__((target("avx512f")))
+int sum_avx512(const int *x, long n) {
+	__m512i a0 = _mm512_setzero_si512(), a1 = a0, a2 = a0, a3 = a0;
+	long i = 0;
+	for(; i + 64 <= n; i += 64) {
+		a0 = _mm512_add_epi32(a0, _mm512_loadu_si512(x + i));
+		a1 = _mm512_add_epi32(a1, _mm512_loadu_si512(x + i + 16));
+		a2 = _mm512_add_epi32(a2, _mm512_loadu_si512(x + i + 32));
+		a3 = _mm512_add_epi32(a3, _mm512_loadu_si512(x + i + 48));
+	}
+	a0 = _mm512_add_epi32(_mm512_add_epi32(a0, a1), _mm512_add_epi32(a2, a3));
+	return (int) ((uint32_t) _mm512_reduce_add_epi32(a0) + (uint32_t) sum_scalar(x + i, n - i));
+}
+#endif // HAVE_X86_SIMD
+
+sum_fn_t sum_best() {
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx512f"))
+		return sum_avx512;
+	if(__builtin_cpu_supports("avx2"))
+		return sum_avx2;
+#endif
+	return sum_scalar;
+}
+
+int sum_ints(const int *x, long n) {
+	static sum_fn_t fn = NULL;
+	if(fn == NULL)
+		fn = sum_best();
+	return fn(x, n);
+}
+
+typedef struct _sum_part_t {
+	_Alignas(CACHELINE) const int *x;
+	long n;
+	sum_fn_t fn;
+	int s;
+} sum_part_t;
+
+void *sum_part(void *arg) {
+	sum_part_t *p = (sum_part_t*) arg;
+	p->s = p->fn(p->x, p->n);
+	return NULL;
+}
+
+int sum_ints_parallel(const int *x, long n, int nthreads, sum_fn_t fn) {
+	pthread_t t[nthreads];
+	sum_part_t part[nthreads];
+	if(fn == NULL)
+		fn = sum_best();
+	// Split on 64-int boundaries so every thread gets whole SIMD blocks.
+	long per = ((n / nthreads) + 63) & ~63L;
+	for(int i = 0; i < nthreads; i++) {
+		long lo = i * per < n ? i * per : n;
+		long hi = lo + per < n ? lo + per : n;
+		part[i].x = x + lo;
+		part[i].n = i == nthreads - 1 ? n - lo : hi - lo;
+		part[i].fn = fn;
+		if(i > 0)
+			Pthread_create(&t[i], NULL, sum_part, &part[i]);
+	}
+	sum_part(&part[0]);
+	uint32_t s = part[0].s;
+	for(int i = 1; i < nthreads; i++) {
+		Pthread_join(t[i], NULL);
+		s += part[i].s;
+	}
+	return (int) s;
+}
+
+#endif // __reduce_h__
@@ -0,0 +1,171 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <semaphore.h>
+#include "common.h"
+#include "common_threads.h"
+#include "drwlock.h"
+
+// The rw-ctr.c / rw-using-sems.c workload (one inc writer, num_threads-1 sum
+// readers over x[SZ]) under different reader-writer locks. The writer does up
+// to ITER writes back to back; readers scan until the writer is done or
+// <secs> seconds pass. We report reader scans/sec and the time the writer
+// waited for each write lock (p50/p99/max).
+//
+// usage: rw-bench [threads] [secs]
+
+#define SZ 1000000
+#define ITER 1000
+
+// rwlock_t from rw-using-sems.c
+typedef struct _rwlock_t {
+	sem_t lock;
+	sem_t writelock;
+	int readers;
+} rwlock_t;
+
+void rwlock_init(rwlock_t *rw) {
+	rw->readers = 0;
+	sem_init(&rw->lock, 0, 1);
+	sem_init(&rw->writelock, 0, 1);
+}
+
+void rwlock_acquire_readlock(rwlock_t *rw) {
+	sem_wait(&rw->lock);
+	rw->readers++;
+	if(rw->readers == 1)	// first reader gets write lock
+		sem_wait(&rw->writelock);
+	sem_post(&rw->lock);
+}
+
+void rwlock_release_readlock(rwlock_t *rw) {
+	sem_wait(&rw->lock);
+	rw->readers--;
+	if(rw->readers == 0)	// last reader releases write lock
+		sem_post(&rw->writelock);
+	sem_post(&rw->lock);
+}
+
+void rwlock_acquire_writelock(rwlock_t *rw) {
+	sem_wait(&rw->writelock);
+}
+
+void rwlock_release_writelock(rwlock_t *rw) {
+	sem_post(&rw->writelock);
+}
+
+enum { PTHREAD, PTHREAD_WPREF, SEMS, DRW_WRITER, DRW_READER, MODES };
+const char *names[MODES] = { "pthread", "pthread-wpref", "sems", "drw-writer", "drw-reader" };
+
+int mode;
+pthread_rwlock_t plock;
+rwlock_t slock;
+drwlock_t dlock;
+volatile int x[SZ] = {0};
+volatile int done = 0;
+double deadline;
+double lat[ITER];
+int writes;
+long long scans;
+pthread_mutex_t m = PTHREAD_MUTEX_INITIALIZER;
+
+void* inc(void* arg) {
+	for(writes = 0; writes < ITER && GetTime() < deadline; writes++) {
+		int i = rand() % SZ;
+		int j = rand() % SZ;
+		double t = GetTime();
+		if(mode == SEMS)
+			rwlock_acquire_writelock(&slock);
+		else if(mode >= DRW_WRITER)
+			drw_write_lock(&dlock);
+		else
+			pthread_rwlock_wrlock(&plock);
+		lat[writes] = GetTime() - t;
+		x[i]+=1;
+		x[j]-=1;
+		if(mode == SEMS)
+			rwlock_release_writelock(&slock);
+		else if(mode >= DRW_WRITER)
+			drw_write_unlock(&dlock);
+		else
+			pthread_rwlock_unlock(&plock);
+	}
+	done = 1;
+	return NULL;
+}
+
+void* sum(void* arg) {
+	drw_slot_t *slot = drw_register(&dlock);
+	long long n = 0;
+	while(!done && GetTime() < deadline) {
+		int s = 0;
+		if(mode == SEMS)
+			rwlock_acquire_readlock(&slock);
+		else if(mode >= DRW_WRITER)
+			drw_read_lock(&dlock, slot);
+		else
+			pthread_rwlock_rdlock(&plock);
+		for(int i = 0; i < SZ; i++) {
+			s += x[i];
+		}
+		if(mode == SEMS)
+			rwlock_release_readlock(&slock);
+		else if(mode >= DRW_WRITER)
+			drw_read_unlock(&dlock, slot);
+		else
+			pthread_rwlock_unlock(&plock);
+		if(s != 0) {
+			printf("oops! sum is %d\n", s);
+			exit(-1);
+		}
+		n++;
+	}
+	pthread_mutex_lock(&m);
+	scans += n;
+	pthread_mutex_unlock(&m);
+	return NULL;
+}
+
+void run(int md, int num_threads, double secs) {
+	pthread_t p[num_threads];
+	pthread_rwlockattr_t attr;
+	pthread_rwlockattr_init(&attr);
+	if(md == PTHREAD_WPREF)
+		pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+	pthread_rwlock_init(&plock, &attr);
+	rwlock_init(&slock);
+	drw_init(&dlock, md == DRW_READER ? DRW_PREFER_READER : DRW_PREFER_WRITER);
+	mode = md;
+	done = 0;
+	scans = 0;
+
+	double t = GetTime();
+	deadline = t + secs;
+	for(int i = 1; i < num_threads; i++)
+		pthread_create(&p[i], NULL, sum, NULL);
+	pthread_create(&p[0], NULL, inc, NULL);
+	for(int i = 0; i < num_threads; i++)
+		pthread_join(p[i], NULL);
+	t = GetTime() - t;
+
+	printf("%-14s %12.1f %6d", names[md], scans / t, writes);
+	if(writes > 0)
+		printf(" %10.1f %10.1f %10.1f\n", Percentile(lat, writes, 50) * 1e6,
+				Percentile(lat, writes, 99) * 1e6, Percentile(lat, writes, 100) * 1e6);
+	else
+		printf(" %10s %10s %10s\n", "-", "-", "-");
+	pthread_rwlock_destroy(&plock);
+}
+
+int main(int argc, char *argv[]) {
+	int num_threads = argc > 1 ? atoi(argv[1]) : 8;
+	double secs = argc > 2 ? atof(argv[2]) : 5;
+	assert(num_threads >= 2 && num_threads - 1 <= DRW_MAX_READERS);
+	printf("%-14s %12s %6s %10s %10s %10s\n", "lock", "scans/sec", "writes",
+			"p50 us", "p99 us", "max us");
+	for(int md = 0; md < MODES; md++)
+		run(md, num_threads, secs);
+	return 0;
+}
@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "common.h"
+#include "common_threads.h"
+#include "salloc.h"
+
+// 1. churn: every thread keeps LIVE blocks of random size (16..SA_MAX bytes)
+//    and <ops> times frees a random one and allocates a new one, writing to
+//    it. Reports Mops/sec for salloc.h and for glibc malloc on 1..N threads.
+// 2. waiters: alloc.c's scenario. 10 threads want 1000, 900, ..., 100 bytes
+//    from a heap of two spans, hold them for a bit and free them. Reports
+//    how many threads had to wait; each was woken exactly once, by a free it
+//    could use (alloc.c wakes every waiter on every free).
+//
+// usage: salloc-bench [max threads] [ops per thread]
+
+#define LIVE 256
+
+int ops;
+int use_malloc;
+
+void *churn(void *arg) {
+	unsigned seed = (unsigned) (long) arg;
+	void *p[LIVE];
+	int sz[LIVE];
+	for(int i = 0; i < LIVE; i++) {
+		sz[i] = 16 + rand_r(&seed) % (SA_MAX - 16);
+		p[i] = use_malloc ? malloc(sz[i]) : my_allocate(sz[i]);
+		*(char*) p[i] = i;
+	}
+	for(int k = 0; k < ops; k++) {
+		int i = rand_r(&seed) % LIVE;
+		if(use_malloc)
+			free(p[i]);
+		else
+			my_free(p[i], sz[i]);
+		sz[i] = 16 + rand_r(&seed) % (SA_MAX - 16);
+		p[i] = use_malloc ? malloc(sz[i]) : my_allocate(sz[i]);
+		*(char*) p[i] = k;
+	}
+	for(int i = 0; i < LIVE; i++) {
+		if(use_malloc)
+			free(p[i]);
+		else
+			my_free(p[i], sz[i]);
+	}
+	if(!use_malloc)
+		salloc_thread_exit();
+	return NULL;
+}
+
+double run(int m, int nthreads) {
+	pthread_t t[nthreads];
+	use_malloc = m;
+	double start = GetTime();
+	for(int i = 0; i < nthreads; i++)
+		Pthread_create(&t[i], NULL, churn, (void*) (long) (i + 1));
+	for(int i = 0; i < nthreads; i++)
+		Pthread_join(t[i], NULL);
+	return 2.0 * ops * nthreads / (GetTime() - start) / 1e6;
+}
+
+void *hold(void *arg) {
+	int s = *(int*) arg;
+	char *p = my_allocate(s);
+	p[s - 1] = 1;
+	usleep(10000);
+	my_free(p, s);
+	salloc_thread_exit();
+	return NULL;
+}
+
+int main(int argc, char *argv[]) {
+	int max = argc > 1 ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+	ops = argc > 2 ? atoi(argv[2]) : 1000000;
+	salloc_init(1L << 30);
+	printf("%7s %14s %14s\n", "threads", "salloc Mops/s", "malloc Mops/s");
+	for(int n = 1; n <= max; n = n < max && n * 2 > max ? max : n * 2) {
+		printf("%7d %14.2f", n, run(0, n));
+		printf(" %14.2f\n", run(1, n));
+		fflush(stdout);
+	}
+	salloc_destroy();
+
+	int num_threads = 10;
+	pthread_t t[num_threads];
+	int szs[num_threads];
+	salloc_init(2 * SA_SPAN);
+	for(int i = 0; i < num_threads; i++) {
+		szs[i] = (num_threads-i) * 100;
+		Pthread_create(&t[i], NULL, hold, &szs[i]);
+	}
+	for(int i = 0; i < num_threads; i++)
+		Pthread_join(t[i], NULL);
+	printf("waiters: %ld of %d threads waited, each woken once by a block it fits\n",
+			atomic_load(&sa.wakeups), num_threads);
+	salloc_destroy();
+	return 0;
+}
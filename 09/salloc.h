@@ -0,0 +1,324 @@
+#ifndef __salloc_h__
+#define __salloc_h__
+
+// Concurrent size-class allocator with the my_allocate/my_free interface of
+// alloc.c, except that it hands out real pointers.
+//
+// Requests are rounded up to a power-of-2 class from 16 to 4096 bytes. Each
+// thread caches up to SA_CACHE free blocks per class and allocates from that
+// cache with no locking at all. An empty cache is refilled with SA_BATCH
+// blocks from the class's central depot (one lock per class), and the depot
+// is refilled by carving blocks off a fixed-size heap, one SA_SPAN-byte span
+// per class at a time. A full cache gives SA_BATCH blocks back to the depot.
+// A side table remembers the class of every span, so a block always goes
+// back to the class it was carved for.
+//
+// When the heap is used up and no class of the right size or bigger has a
+// free block, the request blocks, like my_allocate does in alloc.c. Blocked
+// requests wait in a queue ordered by size, each on its own condition
+// variable. A freed block goes straight to the smallest waiter it fits, so
+// every free wakes at most one thread, and only one it can satisfy, instead
+// of broadcasting to all of them.
+//
+// A waiter only sees blocks that reach a depot or are freed to it directly.
+// Blocks sitting in another thread's cache (up to SA_CACHE per class, and a
+// free that races with a thread just queueing up may still land there) stay
+// out of reach until that cache overflows or its thread calls
+// salloc_thread_exit, which every thread should do before it goes away.
+
+#include <stdlib.h>
+#include <stdatomic.h>
+#include "common_threads.h"
+
+#define SA_MIN_SHIFT 4
+#define SA_CLASSES 9		// 16 .. 4096 bytes
+#define SA_MAX (1 << (SA_MIN_SHIFT + SA_CLASSES - 1))
+#define SA_SPAN SA_MAX
+#define SA_CACHE 64
+#define SA_BATCH 32
+
+typedef struct _sa_block_t {
+	struct _sa_block_t *next;
+} sa_block_t;
+
+typedef struct _sa_depot_t {
+	_Alignas(CACHELINE) pthread_mutex_t lock;
+	sa_block_t *head;
+	int n;
+} sa_depot_t;
+
+typedef struct _sa_waiter_t {
+	int cls;
+	void *got;
+	pthread_cond_t cond;
+	struct _sa_waiter_t *next;
+} sa_waiter_t;
+
+typedef struct _sa_cache_t {
+	sa_block_t *head[SA_CLASSES];
+	int n[SA_CLASSES];
+} sa_cache_t;
+
+struct {
+	sa_depot_t depot[SA_CLASSES];
+	_Alignas(CACHELINE) pthread_mutex_t heap_lock;	// spans and waiters
+	char *heap, *bump, *end;
+	char *cur[SA_CLASSES], *cur_end[SA_CLASSES];	// span being carved per class
+	unsigned char *span_class;
+	sa_waiter_t *waiters;				// ascending by class
+	atomic_int nwaiters;
+	atomic_long wakeups;
+} sa;
+
+__thread sa_cache_t sa_tc;
+
+int sa_class(int size) {
+	assert(size > 0 && size <= SA_MAX);
+	int c = 0;
+	while((1 << (SA_MIN_SHIFT + c)) < size)
+		c++;
+	return c;
+}
+
+void salloc_init(long heap_bytes) {
+	for(int c = 0; c < SA_CLASSES; c++) {
+		pthread_mutex_init(&sa.depot[c].lock, NULL);
+		sa.depot[c].head = NULL;
+		sa.depot[c].n = 0;
+	}
+	pthread_mutex_init(&sa.heap_lock, NULL);
+	heap_bytes &= ~(long) (SA_SPAN - 1);
+	sa.heap = aligned_alloc(SA_SPAN, heap_bytes);
+	sa.span_class = malloc(heap_bytes / SA_SPAN);
+	assert(sa.heap != NULL && sa.span_class != NULL);
+	sa.bump = sa.heap;
+	sa.end = sa.heap + heap_bytes;
+	for(int c = 0; c < SA_CLASSES; c++)
+		sa.cur[c] = sa.cur_end[c] = NULL;
+	sa.waiters = NULL;
+	atomic_init(&sa.nwaiters, 0);
+	atomic_init(&sa.wakeups, 0);
+}
+
+void salloc_destroy() {
+	free(sa.heap);
+	free(sa.span_class);
+}
+
+int sa_class_of(void *p) {
+	return sa.span_class[((char*) p - sa.heap) / SA_SPAN];
+}
+
+// Move up to max blocks from the depot of class c into the thread cache.
+int sa_refill(int c, int max) {
+	sa_depot_t *d = &sa.depot[c];
+	int got = 0;
+	pthread_mutex_lock(&d->lock);
+	while(d->head != NULL && got < max) {
+		sa_block_t *b = d->head;
+		d->head = b->next;
+		b->next = sa_tc.head[c];
+		sa_tc.head[c] = b;
+		got++;
+	}
+	d->n -= got;
+	pthread_mutex_unlock(&d->lock);
+	sa_tc.n[c] += got;
+	return got;
+}
+
+// Carve up to max fresh blocks of class c off the heap into the cache.
+int sa_carve(int c, int max) {
+	long bs = 1L << (SA_MIN_SHIFT + c);
+	int got = 0;
+	pthread_mutex_lock(&sa.heap_lock);
+	while(got < max) {
+		if(sa.cur[c] + bs > sa.cur_end[c]) {
+			if(sa.bump + SA_SPAN > sa.end)
+				break;
+			sa.span_class[(sa.bump - sa.heap) / SA_SPAN] = c;
+			sa.cur[c] = sa.bump;
+			sa.cur_end[c] = sa.bump + SA_SPAN;
+			sa.bump += SA_SPAN;
+		}
+		sa_block_t *b = (sa_block_t*) sa.cur[c];
+		sa.cur[c] += bs;
+		b->next = sa_tc.head[c];
+		sa_tc.head[c] = b;
+		got++;
+	}
+	pthread_mutex_unlock(&sa.heap_lock);
+	sa_tc.n[c] += got;
+	return got;
+}
+
+// Blocks of class c were just pushed to its depot. Hand them to waiters
+// they fit, in case one queued up before seeing them. The fence pairs with
+// the one in my_allocate: either we see the waiter in nwaiters, or it sees
+// the blocks when it looks at the depots again.
+void sa_wake(int c) {
+	atomic_thread_fence(memory_order_seq_cst);
+	if(atomic_load_explicit(&sa.nwaiters, memory_order_relaxed) == 0)
+		return;
+	sa_depot_t *d = &sa.depot[c];
+	pthread_mutex_lock(&sa.heap_lock);
+	while(sa.waiters != NULL && sa.waiters->cls <= c) {
+		pthread_mutex_lock(&d->lock);
+		sa_block_t *b = d->head;
+		if(b != NULL) {
+			d->head = b->next;
+			d->n--;
+		}
+		pthread_mutex_unlock(&d->lock);
+		if(b == NULL)
+			break;
+		sa_waiter_t *w = sa.waiters;
+		sa.waiters = w->next;
+		atomic_fetch_sub(&sa.nwaiters, 1);
+		atomic_fetch_add(&sa.wakeups, 1);
+		w->got = b;
+		pthread_cond_signal(&w->cond);
+	}
+	pthread_mutex_unlock(&sa.heap_lock);
+}
+
+// Give block b of class c to the smallest waiter it fits, else to the depot.
+void sa_release(void *p, int c) {
+	if(atomic_load(&sa.nwaiters) > 0) {
+		pthread_mutex_lock(&sa.heap_lock);
+		sa_waiter_t **pp = &sa.waiters;
+		if(*pp != NULL && (*pp)->cls <= c) {
+			sa_waiter_t *w = *pp;
+			*pp = w->next;
+			atomic_fetch_sub(&sa.nwaiters, 1);
+			atomic_fetch_add(&sa.wakeups, 1);
+			w->got = p;
+			pthread_cond_signal(&w->cond);
+			pthread_mutex_unlock(&sa.heap_lock);
+			return;
+		}
+		pthread_mutex_unlock(&sa.heap_lock);
+	}
+	sa_depot_t *d = &sa.depot[c];
+	sa_block_t *b = (sa_block_t*) p;
+	pthread_mutex_lock(&d->lock);
+	b->next = d->head;
+	d->head = b;
+	d->n++;
+	pthread_mutex_unlock(&d->lock);
+	sa_wake(c);
+}
+
+// Take one block of class c or bigger from any depot.
+void *sa_take_any(int c) {
+	for(int k = c; k < SA_CLASSES; k++) {
+		sa_depot_t *d = &sa.depot[k];
+		pthread_mutex_lock(&d->lock);
+		sa_block_t *b = d->head;
+		if(b != NULL) {
+			d->head = b->next;
+			d->n--;
+		}
+		pthread_mutex_unlock(&d->lock);
+		if(b != NULL)
+			return b;
+	}
+	return NULL;
+}
+
+void *my_allocate(int size) {
+	int c = sa_class(size);
+	if(sa_tc.n[c] == 0 && sa_refill(c, SA_BATCH) == 0 && sa_carve(c, SA_BATCH) == 0) {
+		void *p = sa_take_any(c);
+		if(p != NULL)
+			return p;
+		// Out of memory: queue up by size and wait for a free to hand us
+		// a block directly.
+		sa_waiter_t w = { .cls = c, .got = NULL, .next = NULL };
+		pthread_cond_init(&w.cond, NULL);
+		pthread_mutex_lock(&sa.heap_lock);
+		sa_waiter_t **pp = &sa.waiters;
+		while(*pp != NULL && (*pp)->cls <= c)
+			pp = &(*pp)->next;
+		w.next = *pp;
+		*pp = &w;
+		atomic_fetch_add(&sa.nwaiters, 1);
+		pthread_mutex_unlock(&sa.heap_lock);
+
+		// A free may have reached a depot before it could see us (see
+		// sa_wake).
+		atomic_thread_fence(memory_order_seq_cst);
+		p = sa_take_any(c);
+		pthread_mutex_lock(&sa.heap_lock);
+		if(p != NULL && w.got == NULL) {
+			for(pp = &sa.waiters; *pp != &w; pp = &(*pp)->next)
+				;
+			*pp = w.next;
+			atomic_fetch_sub(&sa.nwaiters, 1);
+		} else {
+			while(w.got == NULL)
+				pthread_cond_wait(&w.cond, &sa.heap_lock);
+			if(p != NULL) {
+				// Got a block both ways; put the depot one back.
+				pthread_mutex_unlock(&sa.heap_lock);
+				sa_release(p, c);
+				pthread_mutex_lock(&sa.heap_lock);
+			}
+			p = w.got;
+		}
+		pthread_mutex_unlock(&sa.heap_lock);
+		pthread_cond_destroy(&w.cond);
+		return p;
+	}
+	sa_block_t *b = sa_tc.head[c];
+	sa_tc.head[c] = b->next;
+	sa_tc.n[c]--;
+	return b;
+}
+
+// Give n blocks from the thread cache of class c back, in one batch.
+void sa_flush(int c, int n) {
+	sa_tc.n[c] -= n;
+	if(atomic_load(&sa.nwaiters) > 0) {
+		for(int i = 0; i < n; i++) {
+			sa_block_t *b = sa_tc.head[c];
+			sa_tc.head[c] = b->next;
+			sa_release(b, c);
+		}
+	} else {
+		sa_block_t *first = sa_tc.head[c], *last = first;
+		for(int i = 1; i < n; i++)
+			last = last->next;
+		sa_tc.head[c] = last->next;
+		sa_depot_t *d = &sa.depot[c];
+		pthread_mutex_lock(&d->lock);
+		last->next = d->head;
+		d->head = first;
+		d->n += n;
+		pthread_mutex_unlock(&d->lock);
+		sa_wake(c);
+	}
+}
+
+// size must be what was passed to my_allocate.
+void my_free(void *p, int size) {
+	int c = sa_class_of(p);
+	assert(size <= 1 << (SA_MIN_SHIFT + c));
+	if(atomic_load_explicit(&sa.nwaiters, memory_order_relaxed) > 0) {
+		sa_release(p, c);
+		return;
+	}
+	sa_block_t *b = (sa_block_t*) p;
+	b->next = sa_tc.head[c];
+	sa_tc.head[c] = b;
+	if(++sa_tc.n[c] > SA_CACHE)
+		sa_flush(c, SA_BATCH);
+}
+
+void salloc_thread_exit() {
+	for(int c = 0; c < SA_CLASSES; c++)
+		if(sa_tc.n[c] > 0)
+			sa_flush(c, sa_tc.n[c]);
+}
+
+#endif // __salloc_h__
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <semaphore.h>
+#include "common.h"
+#include "common_threads.h"
+#include "fsem.h"
+
+// Compares glibc sem_t, the mutex/CV zem_t of sems-using-lock-cv.c and the
+// futex fsem_t of fsem.h on:
+//   wait-sem   the parent/child handoff of wait-sem.c: the parent creates a
+//              child that posts, waits for it and joins it (us per round)
+//   pingpong   two threads handing a token back and forth over two
+//              semaphores, which isolates the sleep/wake path (us per handoff)
+//   fast path  post followed by wait on an uncontended semaphore (ns per pair)
+//
+// usage: sem-bench [rounds]
+
+typedef struct _zem_t {
+	int value;
+	pthread_cond_t cond;
+	pthread_mutex_t lock;
+} zem_t;
+
+void zem_init(zem_t *s, int value) {
+	s->value = value;
+	pthread_cond_init(&s->cond, NULL);
+	pthread_mutex_init(&s->lock, NULL);
+}
+
+void zem_wait(zem_t *s) {
+	pthread_mutex_lock(&s->lock);
+	while(s->value <= 0)
+		pthread_cond_wait(&s->cond, &s->lock);
+	s->value--;
+	pthread_mutex_unlock(&s->lock);
+}
+
+void zem_post(zem_t *s) {
+	pthread_mutex_lock(&s->lock);
+	s->value++;
+	pthread_cond_signal(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+}
+
+enum { SEM, ZEM, FSEM, KINDS };
+const char *names[KINDS] = { "sem_t", "zem_t", "fsem_t" };
+
+typedef struct _anysem_t {
+	sem_t sem;
+	zem_t zem;
+	fsem_t fsem;
+} anysem_t;
+
+int kind;
+long rounds;
+anysem_t s, ping, pong;
+
+void any_init(anysem_t *a, int v) {
+	sem_init(&a->sem, 0, v);
+	zem_init(&a->zem, v);
+	fsem_init(&a->fsem, v);
+}
+
+void any_wait(anysem_t *a) {
+	if(kind == SEM)
+		sem_wait(&a->sem);
+	else if(kind == ZEM)
+		zem_wait(&a->zem);
+	else
+		fsem_wait(&a->fsem);
+}
+
+void any_post(anysem_t *a) {
+	if(kind == SEM)
+		sem_post(&a->sem);
+	else if(kind == ZEM)
+		zem_post(&a->zem);
+	else
+		fsem_post(&a->fsem);
+}
+
+void *child(void *arg) {
+	any_post(&s);
+	return NULL;
+}
+
+void *ponger(void *arg) {
+	for(long i = 0; i < rounds; i++) {
+		any_wait(&ping);
+		any_post(&pong);
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[]) {
+	rounds = argc > 1 ? atol(argv[1]) : 100000;
+	printf("%-8s %14s %14s %14s\n", "", "wait-sem us", "pingpong us", "fast path ns");
+	for(kind = 0; kind < KINDS; kind++) {
+		any_init(&s, 0);
+		any_init(&ping, 0);
+		any_init(&pong, 0);
+
+		double t = GetTime();
+		for(long i = 0; i < rounds / 10; i++) {
+			pthread_t ch;
+			Pthread_create(&ch, NULL, child, NULL);
+			any_wait(&s);
+			Pthread_join(ch, NULL);
+		}
+		double handoff = (GetTime() - t) / (rounds / 10) * 1e6;
+
+		pthread_t p;
+		t = GetTime();
+		Pthread_create(&p, NULL, ponger, NULL);
+		for(long i = 0; i < rounds; i++) {
+			any_post(&ping);
+			any_wait(&pong);
+		}
+		Pthread_join(p, NULL);
+		double pingpong = (GetTime() - t) / (2 * rounds) * 1e6;
+
+		t = GetTime();
+		for(long i = 0; i < rounds * 10; i++) {
+			any_post(&s);
+			any_wait(&s);
+		}
+		double fast = (GetTime() - t) / (rounds * 10) * 1e9;
+
+		printf("%-8s %14.2f %14.2f %14.2f\n", names[kind], handoff, pingpong, fast);
+	}
+
+	// fsem extras: trywait on empty, timedwait that times out, post_n.
+	fsem_t f;
+	fsem_init(&f, 0);
+	assert(fsem_trywait(&f) == -1 && errno == EAGAIN);
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_nsec += 10000000;
+	if(ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+	assert(fsem_timedwait(&f, &ts) == -1 && errno == ETIMEDOUT);
+	fsem_post_n(&f, 3);
+	for(int i = 0; i < 3; i++)
+		assert(fsem_trywait(&f) == 0);
+	assert(fsem_trywait(&f) == -1);
+	return 0;
+}
@@ -20,6 +20,7 @@ void zem_wait(zem_t *s) {
 	pthread_mutex_lock(&s->lock);
 	while(s->value <= 0)
 		pthread_cond_wait(&s->cond, &s->lock);
+	s->value--;
 	pthread_mutex_unlock(&s->lock);
 }
 
@@ -0,0 +1,54 @@
+#ifndef __seqlock_h__
+#define __seqlock_h__
+
+// Sequence lock: readers take no lock and never write shared memory.
+//
+// The writer makes seq odd, updates the data and makes seq even again. A
+// reader samples seq before and after reading; if it was odd or changed, a
+// write overlapped the read and the reader retries:
+//
+//	do {
+//		s = seq_read_begin(&sl);
+//		... read data ...
+//	} while(seq_read_retry(&sl, s));
+//
+// Writers never wait for readers, but a busy writer can make long readers
+// retry over and over. Writers must be serialized by the caller.
+
+#include <stdatomic.h>
+#include "common_threads.h"
+
+typedef struct _seqlock_t {
+	_Alignas(CACHELINE) atomic_uint seq;
+} seqlock_t;
+
+void seq_init(seqlock_t *sl) {
+	atomic_init(&sl->seq, 0);
+}
+
+unsigned seq_read_begin(seqlock_t *sl) {
+	unsigned s;
+	while((s = atomic_load_explicit(&sl->seq, memory_order_acquire)) & 1)
+		cpu_relax();
+	return s;
+}
+
+int seq_read_retry(seqlock_t *sl, unsigned s) {
+	// Keep the data reads above from sinking below the second sample.
+	atomic_thread_fence(memory_order_acquire);
+	return atomic_load_explicit(&sl->seq, memory_order_relaxed) != s;
+}
+
+void seq_write_begin(seqlock_t *sl) {
+	atomic_store_explicit(&sl->seq, atomic_load_explicit(&sl->seq, memory_order_relaxed) + 1,
+			memory_order_relaxed);
+	// Keep the data writes below from floating above the odd seq.
+	atomic_thread_fence(memory_order_release);
+}
+
+void seq_write_end(seqlock_t *sl) {
+	atomic_store_explicit(&sl->seq, atomic_load_explicit(&sl->seq, memory_order_relaxed) + 1,
+			memory_order_release);
+}
+
+#endif // __seqlock_h__
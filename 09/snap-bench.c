@@ -0,0 +1,197 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "common.h"
+#include "common_threads.h"
+#include "seqlock.h"
+#include "epoch.h"
+
+// The rw-ctr.c workload (one inc writer, num_threads-1 sum readers) with
+// three ways of keeping the readers' sums consistent:
+//   rwlock   pthread_rwlock_t, as in rw-ctr.c
+//   seqlock  readers scan without locking and retry if a write overlapped
+//   rcu      x[] is split into CHUNK-int chunks behind a table. The writer
+//            copies the table and the (at most two) chunks it touches,
+//            publishes the new table and retires the old pieces through
+//            epoch.h; readers scan whatever table they loaded.
+// The writer does up to ITER writes, <gap> us apart, for at most <secs>
+// seconds. We report reader scans/sec, seqlock retries, writes done and the
+// writer's time per write (p50/p99/max).
+//
+// usage: snap-bench [threads] [gap us] [secs]
+
+#define SZ 1000000
+#define ITER 1000
+#define CHUNK 4096
+#define NCHUNK ((SZ + CHUNK - 1) / CHUNK)
+
+typedef struct _table_t {
+	int *chunk[NCHUNK];
+} table_t;
+
+enum { RWLOCK, SEQLOCK, RCU, MODES };
+const char *names[MODES] = { "rwlock", "seqlock", "rcu" };
+
+int mode;
+int gap;
+pthread_rwlock_t lock;
+seqlock_t sl;
+epoch_t ep;
+volatile int x[SZ] = {0};
+table_t *_Atomic table;
+volatile int done = 0;
+double deadline;
+double lat[ITER];
+int writes;
+long long scans, retries;
+pthread_mutex_t m = PTHREAD_MUTEX_INITIALIZER;
+
+int *chunk_copy(int *c) {
+	int *n = malloc(CHUNK * sizeof(int));
+	assert(n != NULL);
+	memcpy(n, c, CHUNK * sizeof(int));
+	return n;
+}
+
+void rcu_update(int i, int j) {
+	table_t *old = atomic_load_explicit(&table, memory_order_relaxed);
+	table_t *new = malloc(sizeof(table_t));
+	assert(new != NULL);
+	memcpy(new, old, sizeof(table_t));
+	int ci = i / CHUNK, cj = j / CHUNK;
+	new->chunk[ci] = chunk_copy(old->chunk[ci]);
+	if(cj != ci)
+		new->chunk[cj] = chunk_copy(old->chunk[cj]);
+	new->chunk[ci][i % CHUNK] += 1;
+	new->chunk[cj][j % CHUNK] -= 1;
+	atomic_store(&table, new);
+	epoch_retire(&ep, old->chunk[ci]);
+	if(cj != ci)
+		epoch_retire(&ep, old->chunk[cj]);
+	epoch_retire(&ep, old);
+}
+
+void* inc(void* arg) {
+	for(writes = 0; writes < ITER && GetTime() < deadline; writes++) {
+		int i = rand() % SZ;
+		int j = rand() % SZ;
+		double t = GetTime();
+		if(mode == RWLOCK) {
+			pthread_rwlock_wrlock(&lock);
+			x[i]+=1;
+			x[j]-=1;
+			pthread_rwlock_unlock(&lock);
+		} else if(mode == SEQLOCK) {
+			seq_write_begin(&sl);
+			x[i]+=1;
+			x[j]-=1;
+			seq_write_end(&sl);
+		} else {
+			rcu_update(i, j);
+		}
+		lat[writes] = GetTime() - t;
+		if(gap > 0)
+			usleep(gap);
+	}
+	done = 1;
+	return NULL;
+}
+
+void* sum(void* arg) {
+	epoch_slot_t *slot = epoch_register(&ep);
+	long long n = 0, r = 0;
+	while(!done && GetTime() < deadline) {
+		int s = 0;
+		if(mode == RWLOCK) {
+			pthread_rwlock_rdlock(&lock);
+			for(int i = 0; i < SZ; i++)
+				s += x[i];
+			pthread_rwlock_unlock(&lock);
+		} else if(mode == SEQLOCK) {
+			unsigned v;
+			do {
+				v = seq_read_begin(&sl);
+				s = 0;
+				for(int i = 0; i < SZ; i++)
+					s += x[i];
+			} while(seq_read_retry(&sl, v) && ++r && !done);
+			if(done)
+				break;
+		} else {
+			epoch_enter(&ep, slot);
+			table_t *t = atomic_load(&table);
+			for(int c = 0; c < NCHUNK; c++) {
+				int len = c == NCHUNK - 1 ? SZ - c * CHUNK : CHUNK;
+				for(int i = 0; i < len; i++)
+					s += t->chunk[c][i];
+			}
+			epoch_exit(&ep, slot);
+		}
+		if(s != 0) {
+			printf("oops! sum is %d\n", s);
+			exit(-1);
+		}
+		n++;
+	}
+	pthread_mutex_lock(&m);
+	scans += n;
+	retries += r;
+	pthread_mutex_unlock(&m);
+	return NULL;
+}
+
+void run(int md, int num_threads, double secs) {
+	pthread_t p[num_threads];
+	pthread_rwlock_init(&lock, NULL);
+	seq_init(&sl);
+	epoch_init(&ep);
+	table_t *t = malloc(sizeof(table_t));
+	assert(t != NULL);
+	for(int c = 0; c < NCHUNK; c++) {
+		t->chunk[c] = calloc(CHUNK, sizeof(int));
+		assert(t->chunk[c] != NULL);
+	}
+	atomic_store(&table, t);
+	mode = md;
+	done = 0;
+	scans = retries = 0;
+
+	double start = GetTime();
+	deadline = start + secs;
+	for(int i = 1; i < num_threads; i++)
+		pthread_create(&p[i], NULL, sum, NULL);
+	pthread_create(&p[0], NULL, inc, NULL);
+	for(int i = 0; i < num_threads; i++)
+		pthread_join(p[i], NULL);
+	start = GetTime() - start;
+
+	printf("%-8s %12.1f %10lld %6d", names[md], scans / start, retries, writes);
+	if(writes > 0)
+		printf(" %10.1f %10.1f %10.1f\n", Percentile(lat, writes, 50) * 1e6,
+				Percentile(lat, writes, 99) * 1e6, Percentile(lat, writes, 100) * 1e6);
+	else
+		printf(" %10s %10s %10s\n", "-", "-", "-");
+
+	// All readers are gone, so everything can go.
+	atomic_store(&ep.global, ~0u);
+	epoch_reclaim(&ep);
+	t = atomic_load(&table);
+	for(int c = 0; c < NCHUNK; c++)
+		free(t->chunk[c]);
+	free(t);
+	pthread_rwlock_destroy(&lock);
+}
+
+int main(int argc, char *argv[]) {
+	int num_threads = argc > 1 ? atoi(argv[1]) : 8;
+	gap = argc > 2 ? atoi(argv[2]) : 1000;
+	double secs = argc > 3 ? atof(argv[3]) : 5;
+	assert(num_threads >= 2 && num_threads - 1 <= EPOCH_MAX_READERS);
+	printf("%-8s %12s %10s %6s %10s %10s %10s\n", "mode", "scans/sec", "retries",
+			"writes", "p50 us", "p99 us", "max us");
+	for(int md = 0; md < MODES; md++)
+		run(md, num_threads, secs);
+	return 0;
+}
@@ -0,0 +1,168 @@
+#ifndef __spinlock_h__
+#define __spinlock_h__
+
+// Spinlocks for short critical sections, behind one interface:
+//
+//   SPIN_TTAS    test-and-test-and-set with exponential backoff. Waiters spin
+//                on a cached copy and only write when the lock looks free.
+//   SPIN_TICKET  take a number, wait for it to be served. FIFO fair, but all
+//                waiters spin on the same now_serving line.
+//   SPIN_MCS     queue lock: each waiter spins on a flag in its own node,
+//                the holder hands off by clearing its successor's flag.
+//   SPIN_CLH     queue lock: each waiter spins on its predecessor's node,
+//                then adopts that node for its next acquisition.
+//
+// The queue locks need per-thread state, so every thread keeps a spin_ctx_t
+// (from spin_ctx_init) and passes it to spin_lock/spin_unlock.
+//
+// Waiting spins with cpu_relax and yields the CPU every SPIN_YIELD polls, so
+// the FIFO locks still make progress when there are more threads than cores.
+
+#include <stdlib.h>
+#include <stdatomic.h>
+#include "common_threads.h"
+
+enum { SPIN_TTAS, SPIN_TICKET, SPIN_MCS, SPIN_CLH, SPIN_KINDS };
+
+const char *spin_names[SPIN_KINDS] = { "ttas", "ticket", "mcs", "clh" };
+
+#define SPIN_YIELD 4096
+#define BACKOFF_MIN 4
+#define BACKOFF_MAX 1024
+
+typedef struct _qnode_t {
+	_Alignas(CACHELINE) atomic_int locked;
+	struct _qnode_t *_Atomic next;		// MCS only
+} qnode_t;
+
+typedef struct _spin_ctx_t {
+	qnode_t *node;
+	qnode_t *pred;				// CLH only
+} spin_ctx_t;
+
+typedef struct _spinlock_t {
+	int kind;
+	_Alignas(CACHELINE) atomic_int held;	// TTAS
+	atomic_uint next_ticket;		// ticket
+	atomic_uint now_serving;
+	_Alignas(CACHELINE) qnode_t *_Atomic tail;	// MCS, CLH
+} spinlock_t;
+
+qnode_t *qnode_alloc(int locked) {
+	qnode_t *n = aligned_alloc(CACHELINE, sizeof(qnode_t));
+	assert(n != NULL);
+	atomic_init(&n->locked, locked);
+	atomic_init(&n->next, NULL);
+	return n;
+}
+
+void spin_init(spinlock_t *l, int kind) {
+	l->kind = kind;
+	atomic_init(&l->held, 0);
+	atomic_init(&l->next_ticket, 0);
+	atomic_init(&l->now_serving, 0);
+	// A CLH queue always ends in a released node.
+	atomic_init(&l->tail, kind == SPIN_CLH ? qnode_alloc(0) : NULL);
+}
+
+void spin_ctx_init(spin_ctx_t *ctx) {
+	ctx->node = qnode_alloc(0);
+	ctx->pred = NULL;
+}
+
+// Only once the thread is done with the lock.
+void spin_ctx_destroy(spin_ctx_t *ctx) {
+	free(ctx->node);
+}
+
+// Wait while *flag == val.
+void spin_while(atomic_int *flag, int val) {
+	for(int i = 1; atomic_load_explicit(flag, memory_order_acquire) == val; i++) {
+		cpu_relax();
+		if(i % SPIN_YIELD == 0)
+			sched_yield();
+	}
+}
+
+void spin_lock(spinlock_t *l, spin_ctx_t *ctx) {
+	switch(l->kind) {
+	case SPIN_TTAS: {
+		int delay = BACKOFF_MIN;
+		while(1) {
+			spin_while(&l->held, 1);
+			if(!atomic_exchange_explicit(&l->held, 1, memory_order_acquire))
+				return;
+			for(int i = 0; i < delay; i++)
+				cpu_relax();
+			if(delay < BACKOFF_MAX)
+				delay *= 2;
+		}
+	}
+	case SPIN_TICKET: {
+		unsigned me = atomic_fetch_add_explicit(&l->next_ticket, 1, memory_order_relaxed);
+		for(int i = 1; atomic_load_explicit(&l->now_serving, memory_order_acquire) != me; i++) {
+			cpu_relax();
+			if(i % SPIN_YIELD == 0)
+				sched_yield();
+		}
+		return;
+	}
+	case SPIN_MCS: {
+		qnode_t *n = ctx->node;
+		atomic_store_explicit(&n->next, NULL, memory_order_relaxed);
+		atomic_store_explicit(&n->locked, 1, memory_order_relaxed);
+		qnode_t *pred = atomic_exchange_explicit(&l->tail, n, memory_order_acq_rel);
+		if(pred != NULL) {
+			atomic_store_explicit(&pred->next, n, memory_order_release);
+			spin_while(&n->locked, 1);
+		}
+		return;
+	}
+	case SPIN_CLH: {
+		qnode_t *n = ctx->node;
+		atomic_store_explicit(&n->locked, 1, memory_order_relaxed);
+		ctx->pred = atomic_exchange_explicit(&l->tail, n, memory_order_acq_rel);
+		spin_while(&ctx->pred->locked, 1);
+		return;
+	}
+	}
+}
+
+void spin_unlock(spinlock_t *l, spin_ctx_t *ctx) {
+	switch(l->kind) {
+	case SPIN_TTAS:
+		atomic_store_explicit(&l->held, 0, memory_order_release);
+		return;
+	case SPIN_TICKET: {
+		unsigned me = atomic_load_explicit(&l->now_serving, memory_order_relaxed);
+		atomic_store_explicit(&l->now_serving, me + 1, memory_order_release);
+		return;
+	}
+	case SPIN_MCS: {
+		qnode_t *n = ctx->node;
+		qnode_t *next = atomic_load_explicit(&n->next, memory_order_acquire);
+		if(next == NULL) {
+			qnode_t *expected = n;
+			if(atomic_compare_exchange_strong_explicit(&l->tail, &expected, NULL,
+						memory_order_release, memory_order_relaxed))
+				return;
+			// A successor swapped itself in but hasn't linked to us yet.
+			for(int i = 1; (next = atomic_load_explicit(&n->next, memory_order_acquire)) == NULL; i++) {
+				cpu_relax();
+				if(i % SPIN_YIELD == 0)
+					sched_yield();
+			}
+		}
+		atomic_store_explicit(&next->locked, 0, memory_order_release);
+		return;
+	}
+	case SPIN_CLH: {
+		// Our node now belongs to our successor; recycle the predecessor's.
+		atomic_store_explicit(&ctx->node->locked, 0, memory_order_release);
+		ctx->node = ctx->pred;
+		return;
+	}
+	}
+}
+
+#endif // __spinlock_h__
@@ -0,0 +1,124 @@
+#ifndef __spsc_h__
+#define __spsc_h__
+
+// Lock-free single-producer/single-consumer ring buffer.
+//
+// head is written only by the consumer and tail only by the producer, so no
+// lock is needed: the producer publishes bytes with a release store of tail,
+// the consumer frees slots with a release store of head. Each index sits on
+// its own cache line, next to the owner's cached copy of the other index, so
+// the two sides only touch each other's line when their cache runs out.
+//
+// When the ring is empty (or full) the waiting side spins for a while and
+// then parks on a futex on the other side's index.
+
+#include <stdatomic.h>
+#include "common_threads.h"
+
+#define SPSC_SZ 1024		// must be a power of 2
+#define SPSC_SPINS 1024		// polls before parking on the futex
+
+typedef struct _spsc_t {
+	_Alignas(CACHELINE) atomic_uint head;	// next slot to read
+	unsigned tail_cache;			// consumer's last view of tail
+	_Alignas(CACHELINE) atomic_uint tail;	// next slot to write
+	unsigned head_cache;			// producer's last view of head
+	_Alignas(CACHELINE) atomic_int rparked;	// consumer sleeps on tail
+	atomic_int wparked;			// producer sleeps on head
+	_Alignas(CACHELINE) char buf[SPSC_SZ];
+} spsc_t;
+
+void spsc_init(spsc_t *q) {
+	atomic_init(&q->head, 0);
+	atomic_init(&q->tail, 0);
+	atomic_init(&q->rparked, 0);
+	atomic_init(&q->wparked, 0);
+	q->tail_cache = 0;
+	q->head_cache = 0;
+}
+
+// Wait until *idx moves away from old and return its new value.
+unsigned spsc_park(atomic_uint *idx, unsigned old, atomic_int *parked) {
+	for(int i = 0; i < SPSC_SPINS; i++) {
+		unsigned v = atomic_load_explicit(idx, memory_order_acquire);
+		if(v != old)
+			return v;
+		cpu_relax();
+	}
+	while(1) {
+		// Announce ourselves before the last check. Pairs with the fence
+		// in spsc_kick: either the other side sees parked, or we see its
+		// update. The kernel re-checks *idx == old before sleeping.
+		atomic_store(parked, 1);
+		unsigned v = atomic_load(idx);
+		if(v != old) {
+			atomic_store_explicit(parked, 0, memory_order_relaxed);
+			return v;
+		}
+		Futex_wait(idx, old);
+	}
+}
+
+// Called after moving idx: wake the other side if it went to sleep.
+void spsc_kick(atomic_uint *idx, atomic_int *parked) {
+	atomic_thread_fence(memory_order_seq_cst);
+	if(atomic_load_explicit(parked, memory_order_relaxed)) {
+		atomic_store_explicit(parked, 0, memory_order_relaxed);
+		Futex_wake(idx, 1);
+	}
+}
+
+// Write all n bytes, blocking while the ring is full.
+void spsc_write_n(spsc_t *q, const char *src, int n) {
+	unsigned t = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	while(n > 0) {
+		unsigned room = SPSC_SZ - (t - q->head_cache);
+		if(room == 0) {
+			q->head_cache = atomic_load_explicit(&q->head, memory_order_acquire);
+			room = SPSC_SZ - (t - q->head_cache);
+			if(room == 0) {
+				q->head_cache = spsc_park(&q->head, q->head_cache, &q->wparked);
+				continue;
+			}
+		}
+		int k = n < room ? n : room;
+		for(int i = 0; i < k; i++)
+			q->buf[(t + i) & (SPSC_SZ - 1)] = src[i];
+		t += k;
+		src += k;
+		n -= k;
+		atomic_store_explicit(&q->tail, t, memory_order_release);
+		spsc_kick(&q->tail, &q->rparked);
+	}
+}
+
+// Read between 1 and n bytes, blocking while the ring is empty.
+// Returns the number of bytes read.
+int spsc_read_n(spsc_t *q, char *dst, int n) {
+	unsigned h = atomic_load_explicit(&q->head, memory_order_relaxed);
+	unsigned avail = q->tail_cache - h;
+	if(avail == 0) {
+		q->tail_cache = atomic_load_explicit(&q->tail, memory_order_acquire);
+		if(q->tail_cache == h)
+			q->tail_cache = spsc_park(&q->tail, h, &q->rparked);
+		avail = q->tail_cache - h;
+	}
+	int k = n < avail ? n : avail;
+	for(int i = 0; i < k; i++)
+		dst[i] = q->buf[(h + i) & (SPSC_SZ - 1)];
+	atomic_store_explicit(&q->head, h + k, memory_order_release);
+	spsc_kick(&q->head, &q->wparked);
+	return k;
+}
+
+void spsc_write(spsc_t *q, char c) {
+	spsc_write_n(q, &c, 1);
+}
+
+char spsc_read(spsc_t *q) {
+	char c;
+	spsc_read_n(q, &c, 1);
+	return c;
+}
+
+#endif // __spsc_h__